@@ -0,0 +1,108 @@
+#include "util/dynamicclass.ipp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+
+// Virtual table replica dispatch benchmark - build separately from the test program:
+//   g++ -std=c++17 -O2 -fno-strict-aliasing -o benchmark benchmark.cpp util/dynamicclass.cpp -lpthread
+// The difference between the shared and replicated figures is only meaningful on a machine
+// with several cores, ideally across more than one NUMA node.
+
+namespace {
+
+class counter_base
+{
+public:
+	virtual ~counter_base() = default;
+	virtual int count(int i) { return i; }
+};
+
+
+using replica_extender = util::dynamic_derived_class<counter_base, void, 1>;
+
+int MAME_ABI_CXX_MEMBER_CALL replica_add_override(replica_extender::type &, int i)
+{
+	return i + 1;
+}
+
+int MAME_ABI_CXX_MEMBER_CALL replica_subtract_override(replica_extender::type &, int i)
+{
+	return i - 1;
+}
+
+// calls count(int) on one instance per thread for a fixed time, refreshing rarely, while another thread keeps overriding it
+std::size_t replica_dispatch_benchmark(std::size_t readers, std::size_t replicas, unsigned milliseconds)
+{
+	replica_extender extender("replicated");
+	extender.set_replica_count(replicas);
+	extender.override_member_function(&counter_base::count, &replica_add_override);
+
+	std::atomic<bool> stop(false);
+	std::atomic<std::size_t> total(0);
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; readers > t; ++t)
+	{
+		threads.emplace_back(
+				[&extender, &stop, &total, t] ()
+				{
+					util::set_dynamic_replica_group(t);
+					replica_extender::type *object;
+					auto const i = extender.instantiate(object);
+					counter_base *const volatile p = i.get();
+					std::size_t calls = 0;
+					while (!stop.load(std::memory_order_relaxed))
+					{
+						for (int n = 0; 1048576 > n; ++n)
+							p->count(n);
+						calls += 1048576;
+						extender.refresh_replica();
+					}
+					total.fetch_add(calls, std::memory_order_relaxed);
+				});
+	}
+	threads.emplace_back(
+			[&extender, &stop] ()
+			{
+				for (unsigned n = 0; !stop.load(std::memory_order_relaxed); ++n)
+				{
+					if (n & 1)
+						extender.override_member_function(&counter_base::count, &replica_add_override);
+					else
+						extender.override_member_function(&counter_base::count, &replica_subtract_override);
+				}
+			});
+	std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+	stop.store(true, std::memory_order_relaxed);
+	for (auto &thread : threads)
+		thread.join();
+	return total.load(std::memory_order_relaxed);
+}
+
+} // anonymous namespace
+
+
+
+int main(int argc, char *argv[])
+{
+	unsigned const milliseconds = (1 < argc) ? unsigned(std::strtoul(argv[1], nullptr, 10)) : 1000;
+	std::size_t const readers = (2 < argc) ? std::strtoul(argv[2], nullptr, 10) : 4;
+	if (!milliseconds || !readers)
+	{
+		std::fprintf(stderr, "usage: %s [milliseconds [reader threads]]\n", argv[0]);
+		return 1;
+	}
+
+	printf("Calling count(int) on %u threads for %ums while overriding it continuously (%u hardware threads, %u replica groups)\n",
+			unsigned(readers), milliseconds, std::thread::hardware_concurrency(), unsigned(util::dynamic_replica_group_count()));
+	std::size_t const shared = replica_dispatch_benchmark(readers, 0, milliseconds);
+	std::size_t const replicated = replica_dispatch_benchmark(readers, readers, milliseconds);
+	printf("shared virtual table: %u calls/ms, %u replicas: %u calls/ms\n",
+			unsigned(shared / milliseconds), unsigned(readers), unsigned(replicated / milliseconds));
+
+	return 0;
+}
@@ -1,6 +1,18 @@
 #include "util/dynamicclass.ipp"
+#include "util/dynamicmodule.h"
 
+#include <atomic>
+#include <chrono>
 #include <cstdio>
+#include <thread>
+#include <vector>
+
+
+// exported for the override module test - requires linking with -rdynamic or equivalent
+extern "C" int MAME_ABI_CXX_MEMBER_CALL dynamic_module_test_count(void *, int i)
+{
+	return i + 100;
+}
 
 
 namespace {
@@ -70,6 +82,10 @@ void simple_extender_test()
 	printf("typeid(i2).name(): %s\n", typeid(*i2).name());
 	printf("dynamic_cast<virtual_destructor_base *>(i2) @%p\n", dynamic_cast<virtual_destructor_base *>(i2.get()));
 	printf("dynamic_cast<void *>(i2) @%p\n", dynamic_cast<void *>(i2.get()));
+	printf("test::a.is_instance(i2): %d\n", test1->is_instance(*i2));
+	printf("test::b.is_instance(i2): %d\n", test2->is_instance(*i2));
+	printf("from_instance(i1) == test::a: %d\n", &simple_extender::from_instance(*i1) == test1.get());
+	printf("from_instance(i2) == test::b: %d\n", &simple_extender::from_instance(*i2) == test2.get());
 	printf("i2->x(6): ");
 	i2->x(6);
 	printf("i2->y(7): ");
@@ -256,6 +272,925 @@ void non_virtual_destructor_test()
 	printf("returned %d\n", i1->b(5));
 	printf("i1->c(6): ");
 	printf("returned %d\n", i1->c(6));
+
+	printf("Restoring a(int) using try_restore_base_member_function\n");
+	std::error_code const err = extender.try_restore_base_member_function(&non_virtual_destructor_base::a);
+	printf("err: %d, i1->a(4): ", bool(err));
+	printf("returned %d\n", i1->a(4));
+}
+
+
+void exemplar_test()
+{
+	printf("Testing extender with base class virtual table captured from an exemplar\n");
+
+	simple_extender::type *simple;
+
+	printf("Creating extension class exemplar using an instance of virtual_destructor_base\n");
+	auto extender = std::make_unique<simple_extender>(virtual_destructor_base(), "exemplar");
+	printf("Type info @%p name: %s\n", &extender->type_info(), extender->type_info().name());
+
+	printf("Overriding void x(int) and void y(int) in exemplar\n");
+	extender->override_member_function(&virtual_destructor_base::x, &simple_override);
+	extender->override_member_function(&virtual_destructor_base::y, &simple_override);
+
+	printf("Restoring virtual_destructor_base::y in exemplar before creating any instances\n");
+	extender->restore_base_member_function(&virtual_destructor_base::y);
+
+	printf("Creating instance i1 of class exemplar\n");
+	auto i1 = extender->instantiate(simple);
+	printf("i1 @%p, extended storage @%p\n", i1.get(), simple);
+	printf("i1->x(4): ");
+	i1->x(4);
+	printf("i1->y(5): ");
+	i1->y(5);
+
+	printf("Creating instance i2 of class exemplar without checking for capture\n");
+	auto i2 = extender->instantiate_captured(simple);
+	printf("i2->x(6): ");
+	i2->x(6);
+}
+
+
+class counter_base
+{
+public:
+	virtual ~counter_base() = default;
+	virtual int count(int i) { return i; }
+};
+
+
+using concurrent_extender = util::dynamic_derived_class<counter_base, int, 1>;
+
+int MAME_ABI_CXX_MEMBER_CALL concurrent_override(concurrent_extender::type &object, int i)
+{
+	return object.extra += i;
+}
+
+void concurrent_instantiate_test()
+{
+	printf("Testing concurrent instantiation\n");
+
+	printf("Creating extension class concurrent and overriding count(int)\n");
+	auto extender = std::make_unique<concurrent_extender>("concurrent");
+	extender->override_member_function(&counter_base::count, &concurrent_override);
+
+	printf("Creating 1000 instances on each of 4 threads\n");
+	std::vector<std::thread> threads;
+	std::vector<int> totals(4, 0);
+	for (int t = 0; 4 > t; ++t)
+	{
+		threads.emplace_back(
+				[&extender, &total = totals[t]] ()
+				{
+					for (int n = 0; 1000 > n; ++n)
+					{
+						concurrent_extender::type *object;
+						auto i = extender->instantiate(
+								object,
+								std::piecewise_construct,
+								std::forward_as_tuple(),
+								std::forward_as_tuple(n));
+						total += i->count(n);
+					}
+				});
+	}
+	for (auto &thread : threads)
+		thread.join();
+	for (int t = 0; 4 > t; ++t)
+		printf("thread %d total: %d\n", t, totals[t]);
+}
+
+
+int MAME_ABI_CXX_MEMBER_CALL batch_add_override(concurrent_extender::type &object, int i)
+{
+	return object.extra += i;
+}
+
+int MAME_ABI_CXX_MEMBER_CALL batch_subtract_override(concurrent_extender::type &object, int i)
+{
+	return object.extra -= i;
+}
+
+void batch_invoke_test()
+{
+	printf("Testing calling a member function for instances of multiple classes\n");
+
+	printf("Creating extension classes add and subtract\n");
+	concurrent_extender add("add");
+	concurrent_extender subtract("subtract");
+	add.override_member_function(&counter_base::count, &batch_add_override);
+	subtract.override_member_function(&counter_base::count, &batch_subtract_override);
+
+	printf("Creating three instances of each class interleaved\n");
+	std::vector<concurrent_extender::pointer> instances;
+	std::vector<concurrent_extender::type *> objects;
+	for (int n = 0; 6 > n; ++n)
+	{
+		concurrent_extender::type *object;
+		instances.emplace_back(((n & 1) ? subtract : add).instantiate(
+				object,
+				std::piecewise_construct,
+				std::forward_as_tuple(),
+				std::forward_as_tuple(n * 10)));
+		objects.emplace_back(object);
+	}
+
+	printf("Calling count(3) for all instances\n");
+	std::vector<counter_base *> batch;
+	for (auto const &instance : instances)
+		batch.emplace_back(instance.get());
+	concurrent_extender::invoke_member_function(batch.data(), batch.data() + batch.size(), &counter_base::count, 3);
+	for (int n = 0; 6 > n; ++n)
+		printf("instance %d of %s extra = %d\n", n, concurrent_extender::from_instance(objects[n]->base).type_info().name(), objects[n]->extra);
+	bool unchanged = true;
+	for (int n = 0; 6 > n; ++n)
+		unchanged = unchanged && (batch[n] == instances[n].get());
+	printf("batch order unchanged: %s\n", unchanged ? "yes" : "no");
+
+	printf("Grouping batch by class and calling count(1) for all instances\n");
+	concurrent_extender::sort_by_class(batch.data(), batch.data() + batch.size());
+	for (auto const *object : batch)
+		printf("%s ", concurrent_extender::from_instance(*object).type_info().name());
+	printf("\n");
+	concurrent_extender::invoke_member_function(batch.data(), batch.data() + batch.size(), &counter_base::count, 1);
+	for (int n = 0; 6 > n; ++n)
+		printf("instance %d extra = %d\n", n, objects[n]->extra);
+}
+
+
+using aligned_extender = util::dynamic_derived_class<counter_base, util::dynamic_derived_class_aligned<int, 64>, 1>;
+using prefix_extender = util::dynamic_derived_class<counter_base, util::dynamic_derived_class_prefix<int, 64>, 1>;
+
+int MAME_ABI_CXX_MEMBER_CALL aligned_override(aligned_extender::type &object, int i)
+{
+	return object.extra += i;
+}
+
+int MAME_ABI_CXX_MEMBER_CALL prefix_override(prefix_extender::type &object, int i)
+{
+	return object.extra() += i;
+}
+
+void layout_test()
+{
+	printf("Testing alternate instance layouts\n");
+
+	printf("Creating extension class aligned and overriding count(int)\n");
+	aligned_extender aligned("aligned");
+	aligned.override_member_function(&counter_base::count, &aligned_override);
+
+	printf("Creating instance i1 of class aligned with extra data 5\n");
+	aligned_extender::type *a;
+	auto i1 = aligned.instantiate(a, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(5));
+	printf("i1 aligned to 64 bytes: %d, extended storage at i1: %d\n", !(std::uintptr_t(i1.get()) % 64), std::uintptr_t(i1.get()) == std::uintptr_t(a));
+	printf("i1->count(2): returned %d\n", i1->count(2));
+
+	printf("Creating extension class prefix and overriding count(int)\n");
+	prefix_extender prefix("prefix");
+	prefix.override_member_function(&counter_base::count, &prefix_override);
+
+	printf("Creating instance i2 of class prefix with extra data 7\n");
+	prefix_extender::type *p;
+	auto i2 = prefix.instantiate(p, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(7));
+	printf("extended storage at i2: %d, extra data precedes i2: %d\n", std::uintptr_t(i2.get()) == std::uintptr_t(p), std::uintptr_t(&p->extra()) < std::uintptr_t(i2.get()));
+	printf("extra data shares a cache line with i2: %d\n", (std::uintptr_t(&p->extra()) / 64) == (std::uintptr_t(i2.get()) / 64));
+	printf("i2->count(3): returned %d\n", i2->count(3));
+}
+
+
+
+class runtime_count_base
+{
+public:
+	virtual ~runtime_count_base() = default;
+	virtual int first(int i) { return i; }
+	virtual int second(int i) { return i * 2; }
+};
+
+
+using runtime_extender = util::dynamic_derived_class<runtime_count_base, int, util::dynamic_virtual_count>;
+
+int MAME_ABI_CXX_MEMBER_CALL runtime_override(runtime_extender::type &object, int i)
+{
+	return object.extra + i;
+}
+
+void runtime_count_test()
+{
+	printf("Testing number of virtual member functions specified at run time\n");
+
+	printf("Creating extension class runtime with two overridable member functions and overriding first(int)\n");
+	runtime_extender runtime("runtime", 2);
+	runtime.override_member_function(&runtime_count_base::first, &runtime_override);
+
+	printf("Creating extension class runtime2 from runtime, restoring first(int) and overriding second(int)\n");
+	runtime_extender runtime2(runtime, "runtime2");
+	runtime2.restore_base_member_function(&runtime_count_base::first);
+	runtime2.override_member_function(&runtime_count_base::second, &runtime_override);
+
+	printf("Creating instance i1 of class runtime with extra data 10\n");
+	runtime_extender::type *object;
+	auto i1 = runtime.instantiate(object, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(10));
+	printf("i1->first(1): returned %d, i1->second(1): returned %d\n", i1->first(1), i1->second(1));
+
+	printf("Creating instance i2 of class runtime2 with extra data 20\n");
+	auto i2 = runtime2.instantiate(object, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(20));
+	printf("i2->first(1): returned %d, i2->second(1): returned %d\n", i2->first(1), i2->second(1));
+
+	printf("Creating extension class mismatched with one overridable member function\n");
+	try
+	{
+		util::dynamic_derived_class<runtime_count_base, int, 2> mismatched("mismatched", 1);
+		printf("creating class mismatched succeeded\n");
+	}
+	catch (std::invalid_argument const &e)
+	{
+		printf("creating class mismatched failed: %s\n", e.what());
+	}
+}
+
+
+
+using profile_extender = util::dynamic_derived_class<runtime_count_base, int, 2>;
+
+int MAME_ABI_CXX_MEMBER_CALL profile_override(profile_extender::type &object, int i)
+{
+	return object.extra + i;
+}
+
+void profile_test()
+{
+	printf("Testing saving and applying override profiles\n");
+
+	printf("Creating extension classes one and two\n");
+	profile_extender one("one");
+	profile_extender two("two");
+
+	printf("Saving profile base before creating any instances\n");
+	util::dynamic_derived_class_profile base_profile("base");
+	base_profile.save(one);
+	base_profile.save(two);
+
+	printf("Overriding first(int) in one and second(int) in two and saving profile overridden\n");
+	one.override_member_function(&runtime_count_base::first, &profile_override);
+	two.override_member_function(&runtime_count_base::second, &profile_override);
+	util::dynamic_derived_class_profile overridden("overridden");
+	overridden.save(one);
+	overridden.save(two);
+	printf("profile %s contains one: %d, contains two: %d\n", overridden.name().c_str(), overridden.contains(one), overridden.contains(two));
+
+	printf("Creating instance i1 of class one and i2 of class two\n");
+	profile_extender::type *object;
+	auto i1 = one.instantiate(object, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(100));
+	auto i2 = two.instantiate(object, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(200));
+	printf("i1->first(1): %d, i1->second(1): %d, i2->first(1): %d, i2->second(1): %d\n", i1->first(1), i1->second(1), i2->first(1), i2->second(1));
+
+	printf("Applying profile base\n");
+	base_profile.apply();
+	printf("i1->first(1): %d, i1->second(1): %d, i2->first(1): %d, i2->second(1): %d\n", i1->first(1), i1->second(1), i2->first(1), i2->second(1));
+
+	printf("Applying profile overridden to one\n");
+	overridden.apply(one);
+	printf("i1->first(1): %d, i1->second(1): %d, i2->first(1): %d, i2->second(1): %d\n", i1->first(1), i1->second(1), i2->first(1), i2->second(1));
+
+	printf("Removing one from profile overridden and applying it\n");
+	overridden.remove(one);
+	overridden.apply();
+	printf("i1->first(1): %d, i1->second(1): %d, i2->first(1): %d, i2->second(1): %d\n", i1->first(1), i1->second(1), i2->first(1), i2->second(1));
+	printf("profile %s contains one: %d, contains two: %d\n", overridden.name().c_str(), overridden.contains(one), overridden.contains(two));
+}
+
+
+
+struct layered_parent_data
+{
+	int value;
+};
+
+struct layered_child_data : layered_parent_data
+{
+	int scale;
+};
+
+using layered_parent_extender = util::dynamic_derived_class<runtime_count_base, layered_parent_data, 2>;
+using layered_child_extender = util::dynamic_derived_class<runtime_count_base, layered_child_data, 2>;
+
+layered_parent_extender *layered_parent;
+
+int MAME_ABI_CXX_MEMBER_CALL layered_parent_override(layered_parent_extender::type &object, int i)
+{
+	return object.extra.value + layered_parent->call_base_member_function(object, &runtime_count_base::first, i);
+}
+
+int MAME_ABI_CXX_MEMBER_CALL layered_parent_second_override(layered_parent_extender::type &object, int i)
+{
+	return object.extra.value + layered_parent->call_base_member_function(object, &runtime_count_base::second, i);
+}
+
+int MAME_ABI_CXX_MEMBER_CALL layered_child_override(layered_child_extender::type &object, int i)
+{
+	return object.extra.scale * object.call_base_member_function(&runtime_count_base::second, i);
+}
+
+void layered_test()
+{
+	printf("Testing dynamic derived class layered on another dynamic derived class\n");
+
+	printf("Creating extension class parent and overriding first(int)\n");
+	layered_parent_extender parent("parent");
+	layered_parent = &parent;
+	parent.override_member_function(&runtime_count_base::first, &layered_parent_override);
+
+	printf("Creating extension class child layered on parent and overriding second(int)\n");
+	layered_child_extender child("child", parent);
+	child.override_member_function(&runtime_count_base::second, &layered_child_override);
+
+	printf("Creating instance i1 of class parent with value 10 and i2 of class child with value 20 and scale 3\n");
+	layered_parent_extender::type *p;
+	layered_child_extender::type *c;
+	auto i1 = parent.instantiate(p, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(layered_parent_data{ 10 }));
+	auto i2 = child.instantiate(c, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(layered_child_data{ { 20 }, 3 }));
+	printf("typeid(*i2).name(): %s, parent.is_instance(*i2): %d, child.is_instance(*i2): %d\n", typeid(*i2).name(), parent.is_instance(*i2), child.is_instance(*i2));
+	printf("i1->first(1): %d, i1->second(1): %d\n", i1->first(1), i1->second(1));
+	printf("i2->first(1): %d, i2->second(1): %d\n", i2->first(1), i2->second(1));
+
+	printf("Overriding second(int) in parent\n");
+	parent.override_member_function(&runtime_count_base::second, &layered_parent_second_override);
+	printf("i1->first(1): %d, i1->second(1): %d\n", i1->first(1), i1->second(1));
+	printf("i2->first(1): %d, i2->second(1): %d\n", i2->first(1), i2->second(1));
+
+	printf("Restoring first(int) in parent\n");
+	parent.restore_base_member_function(&runtime_count_base::first);
+	printf("i1->first(1): %d, i1->second(1): %d\n", i1->first(1), i1->second(1));
+	printf("i2->first(1): %d, i2->second(1): %d\n", i2->first(1), i2->second(1));
+
+	printf("Restoring second(int) in child\n");
+	child.restore_base_member_function(&runtime_count_base::second);
+	printf("i2->first(1): %d, i2->second(1): %d\n", i2->first(1), i2->second(1));
+
+	printf("Creating extension class copy using child as a prototype and instance i3 with value 30 and scale 2\n");
+	layered_child_extender copy(child, "copy");
+	auto i3 = copy.instantiate(c, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(layered_child_data{ { 30 }, 2 }));
+	printf("typeid(*i3).name(): %s, copy.is_instance(*i3): %d\n", typeid(*i3).name(), copy.is_instance(*i3));
+	printf("i3->first(1): %d, i3->second(1): %d\n", i3->first(1), i3->second(1));
+
+	printf("Saving child in profile layered, overriding first(int) in parent and applying profile layered to child\n");
+	util::dynamic_derived_class_profile layered("layered");
+	layered.save(child);
+	parent.override_member_function(&runtime_count_base::first, &layered_parent_override);
+	layered.apply(child);
+	printf("i1->first(1): %d, i2->first(1): %d\n", i1->first(1), i2->first(1));
+}
+
+
+
+class listener
+{
+public:
+	virtual ~listener() = default;
+	virtual int notify(int i) { return -i; }
+};
+
+class listening_base : public counter_base, public listener
+{
+public:
+	~listening_base() { printf("listening_base::~listening_base\n"); }
+};
+
+using listening_extender = util::dynamic_derived_class<listening_base, int, 1>;
+
+int MAME_ABI_CXX_MEMBER_CALL listening_override(listening_extender::type &object, int i)
+{
+	return object.extra + object.call_base_member_function(&listener::notify, i);
+}
+
+void secondary_base_test()
+{
+	printf("Testing base class with secondary virtual table\n");
+
+	printf("Creating extension class listening, adding secondary base listener and overriding notify(int)\n");
+	listening_extender listening("listening");
+	listening.add_secondary_base<listener>(1);
+	listening.override_member_function<&listening_override>(&listener::notify);
+
+	printf("Creating instance i1 of class listening with extra data 10\n");
+	listening_extender::type *object;
+	auto i1 = listening.instantiate(object, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(10));
+	listener &l = *i1;
+	printf("typeid(l).name(): %s\n", typeid(l).name());
+	printf("dynamic_cast<listening_base *>(&l) == i1: %d\n", dynamic_cast<listening_base *>(&l) == i1.get());
+	printf("l.notify(3): returned %d\n", l.notify(3));
+	printf("i1->count(3): returned %d\n", i1->count(3));
+
+	printf("Restoring notify(int)\n");
+	listening.restore_base_member_function(&listener::notify);
+	printf("l.notify(3): returned %d\n", l.notify(3));
+
+	printf("Destroying instance i1 through pointer to listener\n");
+	std::unique_ptr<listener> i2(static_cast<listener *>(i1.release()));
+	i2.reset();
+}
+
+
+
+using tracked_extender = util::dynamic_derived_class<counter_base, util::dynamic_derived_class_tracked<int>, 1>;
+
+int MAME_ABI_CXX_MEMBER_CALL tracked_add_override(tracked_extender::type &object, int i)
+{
+	return i + object.extra;
+}
+
+int MAME_ABI_CXX_MEMBER_CALL tracked_multiply_override(tracked_extender::type &object, int i)
+{
+	return i * object.extra;
+}
+
+void tracked_test()
+{
+	printf("Testing instance tracking\n");
+
+	printf("Creating extension classes add and multiply\n");
+	tracked_extender add("add");
+	add.override_member_function(&counter_base::count, &tracked_add_override);
+	tracked_extender multiply("multiply");
+	multiply.override_member_function(&counter_base::count, &tracked_multiply_override);
+
+	printf("Creating instances i1, i2 and i3 of class add with extra data 1, 2 and 3\n");
+	tracked_extender::type *object;
+	auto i1 = add.instantiate(object, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(1));
+	auto i2 = add.instantiate(object, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(2));
+	auto i3 = add.instantiate(object, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(3));
+	printf("add.instance_count(): %u\n", unsigned(add.instance_count()));
+	add.for_each_instance([] (tracked_extender::type &instance) { printf("instance with extra data %d\n", instance.extra); });
+
+	printf("Destroying instance i2\n");
+	i2.reset();
+	printf("add.instance_count(): %u\n", unsigned(add.instance_count()));
+	printf("i1->count(5): returned %d, i3->count(5): returned %d\n", i1->count(5), i3->count(5));
+
+	printf("Moving instances of add to multiply\n");
+	printf("add.retarget_instances(multiply): moved %u\n", unsigned(add.retarget_instances(multiply)));
+	printf("add.instance_count(): %u, multiply.instance_count(): %u\n", unsigned(add.instance_count()), unsigned(multiply.instance_count()));
+	printf("typeid(*i1).name(): %s\n", typeid(*i1).name());
+	printf("i1->count(5): returned %d, i3->count(5): returned %d\n", i1->count(5), i3->count(5));
+
+	printf("Destroying instances i1 and i3\n");
+	i1.reset();
+	i3.reset();
+	printf("multiply.instance_count(): %u\n", unsigned(multiply.instance_count()));
+}
+
+
+
+using reference_extender = util::dynamic_derived_class<counter_base, int, 1>;
+
+int MAME_ABI_CXX_MEMBER_CALL reference_override(reference_extender::type &object, int i)
+{
+	return i + object.extra;
+}
+
+void reference_test()
+{
+	printf("Testing classes owned by their instances\n");
+
+	printf("Creating extension class single with single-thread reference counting\n");
+	auto single = std::make_unique<reference_extender>("single");
+	single->set_reference_mode(util::dynamic_reference_mode::SINGLE_THREAD);
+	single->override_member_function(&counter_base::count, &reference_override);
+
+	printf("Creating instances i1 and i2 of class single with extra data 1 and 2\n");
+	reference_extender::type *object;
+	auto i1 = single->instantiate(object, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(1));
+	auto i2 = single->instantiate(object, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(2));
+	printf("single->reference_count(): %u\n", unsigned(single->reference_count()));
+
+	printf("Releasing class single\n");
+	reference_extender::release(std::move(single));
+	printf("reference_extender::from_instance(*i1).reference_count(): %u\n", unsigned(reference_extender::from_instance(*i1).reference_count()));
+	printf("i1->count(5): returned %d\n", i1->count(5));
+	printf("Destroying instance i1\n");
+	i1.reset();
+	printf("reference_extender::from_instance(*i2).reference_count(): %u\n", unsigned(reference_extender::from_instance(*i2).reference_count()));
+	printf("Destroying instance i2, reclaiming class single\n");
+	i2.reset();
+
+	printf("Creating extension class sharded with sharded reference counting\n");
+	auto sharded = std::make_unique<reference_extender>("sharded");
+	sharded->set_reference_mode(util::dynamic_reference_mode::SHARDED);
+	sharded->override_member_function(&counter_base::count, &reference_override);
+
+	printf("Creating 1000 instances on each of 4 threads, keeping every hundredth instance\n");
+	std::vector<std::thread> threads;
+	std::vector<std::vector<reference_extender::pointer> > kept(4);
+	for (int t = 0; 4 > t; ++t)
+	{
+		threads.emplace_back(
+				[&sharded, &instances = kept[t]] ()
+				{
+					for (int n = 0; 1000 > n; ++n)
+					{
+						reference_extender::type *object;
+						auto i = sharded->instantiate(
+								object,
+								std::piecewise_construct,
+								std::forward_as_tuple(),
+								std::forward_as_tuple(n));
+						if (!(n % 100))
+							instances.emplace_back(std::move(i));
+					}
+				});
+	}
+	for (auto &thread : threads)
+		thread.join();
+	printf("sharded->reference_count(): %u\n", unsigned(sharded->reference_count()));
+
+	printf("Releasing class sharded\n");
+	reference_extender::release(std::move(sharded));
+	printf("reference_extender::from_instance(*kept[0][1]).reference_count(): %u\n", unsigned(reference_extender::from_instance(*kept[0][1]).reference_count()));
+
+	printf("Destroying kept instances on 4 threads, reclaiming class sharded\n");
+	threads.clear();
+	for (int t = 0; 4 > t; ++t)
+		threads.emplace_back([&instances = kept[(t + 1) % 4]] () { instances.clear(); });
+	for (auto &thread : threads)
+		thread.join();
+}
+
+
+
+struct static_counter_name { static constexpr char const value[] = "static_counter"; };
+
+int MAME_ABI_CXX_MEMBER_CALL static_counter_override(reference_extender::type &object, int i)
+{
+	return object.extra * i;
+}
+
+using static_counter = util::static_dynamic_class<
+		counter_base,
+		int,
+		1,
+		static_counter_name,
+		util::dynamic_override<&counter_base::count, &static_counter_override> >;
+
+struct static_captured_name { static constexpr char const value[] = "static_captured"; };
+
+using static_captured = util::static_dynamic_class<
+		counter_base,
+		int,
+		1,
+		static_captured_name,
+		util::dynamic_capture_exemplar,
+		util::dynamic_override<&counter_base::count, &static_counter_override> >;
+
+void static_class_test()
+{
+	printf("Testing class with overrides known at compile time\n");
+
+	printf("static_counter::type_info().name(): %s\n", static_counter::type_info().name());
+
+	printf("Creating instance i1 of class static_counter with extra data 3\n");
+	static_counter::type *object;
+	auto i1 = static_counter::instantiate(object, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(3));
+	printf("typeid(*i1).name(): %s\n", typeid(*i1).name());
+	printf("static_counter::is_instance(*i1): %d\n", static_counter::is_instance(*i1));
+	printf("i1->count(5): returned %d\n", i1->count(5));
+	printf("static_counter::get().call_base_member_function(*object, &counter_base::count, 5): returned %d\n", static_counter::get().call_base_member_function(*object, &counter_base::count, 5));
+
+	printf("Creating instance i2 of class static_captured with exemplar capture and extra data 4\n");
+	auto i2 = static_captured::instantiate(object, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(4));
+	printf("static_captured::is_instance(*i2): %d, static_counter::is_instance(*i2): %d\n", static_captured::is_instance(*i2), static_counter::is_instance(*i2));
+	printf("i2->count(5): returned %d\n", i2->count(5));
+}
+
+
+
+void print_stats(util::dynamic_derived_class_stats const &stats)
+{
+	printf("  live instances: %u, peak instances: %u, created: %u, destroyed: %u\n",
+			unsigned(stats.live_instances), unsigned(stats.peak_instances), unsigned(stats.instances_created), unsigned(stats.instances_destroyed));
+	printf("  overrides: %u, restores: %u\n", unsigned(stats.overrides), unsigned(stats.restores));
+	printf("  vtable bytes: %u, name bytes: %u, type info bytes: %u\n",
+			unsigned(stats.vtable_bytes), unsigned(stats.name_bytes), unsigned(stats.type_info_bytes));
+}
+
+void stats_test()
+{
+	printf("Testing statistics (counters %s)\n", MAME_DYNAMIC_CLASS_STATS ? "enabled" : "disabled");
+
+	printf("Creating extension class counted, overriding and restoring count(int)\n");
+	reference_extender counted("counted");
+	counted.override_member_function(&counter_base::count, &reference_override);
+	counted.restore_base_member_function(&counter_base::count);
+	counted.override_member_function(&counter_base::count, &reference_override);
+
+	printf("Creating instances i1 and i2 of class counted, destroying i1\n");
+	reference_extender::type *object;
+	auto i1 = counted.instantiate(object, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(1));
+	auto i2 = counted.instantiate(object, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(2));
+	i1.reset();
+	printf("counted.stats():\n");
+	print_stats(counted.stats());
+
+	auto const aggregate = util::dynamic_derived_class_aggregate_stats();
+	printf("util::dynamic_derived_class_aggregate_stats():\n");
+	printf("  classes: %u, created: %u, destroyed: %u\n",
+			unsigned(aggregate.classes), unsigned(aggregate.classes_created), unsigned(aggregate.classes_destroyed));
+	print_stats(aggregate);
+	printf("  resolve calls: %u\n", unsigned(aggregate.resolve_calls));
+}
+
+
+
+void journal_test()
+{
+	printf("Testing override change journal\n");
+
+	printf("Creating journal with capacity 4 and installing it\n");
+	util::dynamic_derived_class_journal journal(4);
+	util::dynamic_derived_class_journal::install(&journal);
+
+	printf("Creating extension class journaled and instance i1, overriding and restoring count(int) three times\n");
+	reference_extender journaled("journaled");
+	reference_extender::type *object;
+	auto i1 = journaled.instantiate(object, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(1));
+	for (int i = 0; 3 > i; ++i)
+	{
+		journaled.override_member_function(&counter_base::count, &reference_override);
+		journaled.restore_base_member_function(&counter_base::count);
+	}
+	util::dynamic_derived_class_journal::install(nullptr);
+
+	auto const events = journal.snapshot();
+	printf("journal.recorded(): %u, journal.snapshot().size(): %u\n", unsigned(journal.recorded()), unsigned(events.size()));
+	for (auto const &e : events)
+		printf("%s %s slot %u\n", e.class_name, e.restore ? "restore" : "override", unsigned(e.slot));
+
+	printf("Dumping journal:\n");
+	journal.dump([] (void *, char const *text, std::size_t length) { fwrite(text, 1, length, stdout); }, nullptr);
+}
+
+
+
+void error_code_test()
+{
+	printf("Testing error codes\n");
+
+	std::error_code err;
+	printf("Creating extension class with invalid name bad::\n");
+	auto bad = reference_extender::try_create("bad::", err);
+	printf("bad: %p, err == INVALID_CLASS_NAME: %d, err.message(): %s\n", static_cast<void *>(bad.get()), err == util::dynamic_class_error::INVALID_CLASS_NAME, err.message().c_str());
+
+	printf("Creating extension class mismatched with one overridable member function\n");
+	auto mismatched = util::dynamic_derived_class<runtime_count_base, int, 2>::try_create("mismatched", 1, err);
+	printf("mismatched: %p, err.category().name(): %s, err.message(): %s\n", static_cast<void *>(mismatched.get()), err.category().name(), err.message().c_str());
+
+	printf("Creating extension class checked\n");
+	auto checked = reference_extender::try_create("checked", err);
+	printf("checked: %d, err: %d\n", bool(checked), bool(err));
+
+	std::size_t index = ~std::size_t(0);
+	err = reference_extender::try_resolve_member_function(&counter_base::count, index);
+	printf("try_resolve_member_function(&counter_base::count): err: %d, index: %u\n", bool(err), unsigned(index));
+
+	printf("Overriding count(int) in checked and creating instance i1 with extra data 3\n");
+	err = checked->try_override_member_function(&counter_base::count, &reference_override);
+	printf("try_override_member_function: err: %d\n", bool(err));
+	reference_extender::type *object;
+	auto i1 = checked->instantiate(object, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(3));
+	printf("i1->count(2): returned %d\n", i1->count(2));
+	err = checked->try_restore_base_member_function(&counter_base::count);
+	printf("try_restore_base_member_function: err: %d, i1->count(2): returned %d\n", bool(err), i1->count(2));
+}
+
+
+
+void override_module_test()
+{
+	printf("Testing override modules\n");
+
+	printf("Creating extension class hot and instance i1\n");
+	reference_extender hot("hot");
+	reference_extender::type *object;
+	auto i1 = hot.instantiate(object, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(1));
+
+	printf("Creating loader, registering reader and binding count(int) to dynamic_module_test_count\n");
+	util::dynamic_override_loader loader;
+	util::dynamic_override_loader::reader reader(loader);
+	std::error_code err = loader.bind(hot, &counter_base::count, "dynamic_module_test_count");
+	printf("bind: err: %d\n", bool(err));
+
+	printf("Loading missing module\n");
+	err = loader.load("./dynamic_module_test_missing.so");
+	printf("load: err.message(): %s, i1->count(2): returned %d\n", err.message().c_str(), i1->count(2));
+
+	printf("Loading main program as module\n");
+	err = loader.load(nullptr);
+	if (err)
+	{
+		printf("load: err.message(): %s\n", err.message().c_str());
+		return;
+	}
+	printf("load: err: %d, i1->count(2): returned %d\n", bool(err), i1->count(2));
+
+	printf("Binding count(int) to missing symbol\n");
+	err = loader.bind(hot, &counter_base::count, "dynamic_module_test_missing");
+	printf("bind: err.message(): %s\n", err.message().c_str());
+
+	printf("Reloading main program as module\n");
+	err = loader.load(nullptr);
+	printf("load: err: %d, i1->count(2): returned %d, loader.retired(): %u\n", bool(err), i1->count(2), unsigned(loader.retired()));
+	printf("loader.reclaim() before quiescent state: %u\n", unsigned(loader.reclaim()));
+	reader.quiescent();
+	printf("loader.reclaim() after quiescent state: %u\n", unsigned(loader.reclaim()));
+
+	printf("Unloading module\n");
+	loader.unload();
+	printf("i1->count(2): returned %d, loader.retired(): %u\n", i1->count(2), unsigned(loader.retired()));
+	reader.offline();
+	printf("loader.reclaim() with reader offline: %u\n", unsigned(loader.reclaim()));
+}
+
+
+
+void override_cache_test()
+{
+	printf("Testing override cache\n");
+
+	char const *const path = "dynamic_class_test.cache";
+
+	printf("Creating extension class cached and overriding count(int) with dynamic_module_test_count\n");
+	util::dynamic_override_cache cache;
+	{
+		reference_extender cached("cached");
+		cached.override_member_function(&counter_base::count, reinterpret_cast<int MAME_ABI_CXX_MEMBER_CALL (*)(reference_extender::type &, int)>(std::uintptr_t(&dynamic_module_test_count)));
+		std::error_code err = cache.add(cached);
+		if (err)
+		{
+			printf("add: err.message(): %s\n", err.message().c_str());
+			return;
+		}
+		printf("add: err: %d\n", bool(err));
+
+		printf("Creating extension class unexported and overriding count(int) with function that is not exported\n");
+		reference_extender unexported("unexported");
+		unexported.override_member_function(&counter_base::count, &reference_override);
+		err = cache.add(unexported);
+		printf("add: err.message(): %s\n", err.message().c_str());
+
+		printf("Creating extension class listening and overriding listener::notify(int)\n");
+		listening_extender listening("listening");
+		listening.add_secondary_base<listener>(1);
+		listening.override_member_function<&listening_override>(&listener::notify);
+		err = cache.add(listening);
+		printf("add: err.message(): %s\n", err.message().c_str());
+
+		err = cache.write(path);
+		printf("write: err: %d\n", bool(err));
+	}
+
+	printf("Reading cache and creating extension classes cached and uncached\n");
+	std::error_code err = cache.read(path);
+	printf("read: err: %d, cache.size(): %u\n", bool(err), unsigned(cache.size()));
+	reference_extender cached("cached");
+	reference_extender uncached("uncached");
+	printf("cache.contains(cached): %d, cache.contains(uncached): %d\n", cache.contains(cached), cache.contains(uncached));
+	err = cache.apply(cached);
+	printf("apply(cached): err: %d\n", bool(err));
+	err = cache.apply(uncached);
+	printf("apply(uncached): err.message(): %s\n", err.message().c_str());
+
+	printf("Creating instance i1 of class cached\n");
+	reference_extender::type *object;
+	auto i1 = cached.instantiate(object, std::piecewise_construct, std::forward_as_tuple(), std::forward_as_tuple(1));
+	printf("i1->count(2): returned %d\n", i1->count(2));
+
+	cache.close();
+	std::remove(path);
+}
+
+
+
+using columns_extender = util::dynamic_derived_class<counter_base, util::dynamic_derived_class_columns<int, std::uint8_t>, 1>;
+
+int MAME_ABI_CXX_MEMBER_CALL columns_override(columns_extender::type &object, int i)
+{
+	object.column<1>() = 1;
+	return object.column<0>() += i;
+}
+
+void columns_test()
+{
+	printf("Testing column instance layout\n");
+
+	printf("Creating extension class columns and overriding count(int)\n");
+	columns_extender columns("columns");
+	columns.override_member_function(&counter_base::count, &columns_override);
+
+	printf("Creating instances i1, i2, i3 and i4\n");
+	columns_extender::type *objects[4];
+	auto i1 = columns.instantiate(objects[0]);
+	auto i2 = columns.instantiate(objects[1]);
+	auto i3 = columns.instantiate(objects[2]);
+	auto i4 = columns.instantiate(objects[3]);
+	printf("columns.row_count(): %u, rows: %u %u %u %u\n", unsigned(columns.row_count()), objects[0]->row, objects[1]->row, objects[2]->row, objects[3]->row);
+
+	printf("i1->count(1): returned %d, i3->count(3): returned %d, i4->count(4): returned %d\n", i1->count(1), i3->count(3), i4->count(4));
+
+	printf("Destroying i1\n");
+	i1.reset();
+	printf("columns.row_count(): %u, rows: %u %u %u\n", unsigned(columns.row_count()), objects[1]->row, objects[2]->row, objects[3]->row);
+	printf("i4->count(10): returned %d\n", i4->count(10));
+
+	int total = 0;
+	int const *const counts = columns.column<0>();
+	for (std::size_t i = 0; columns.row_count() > i; ++i)
+		total += counts[i];
+	printf("Sum of column 0: %d\n", total);
+
+	std::uint8_t *const flags = columns.column<1>();
+	for (std::size_t i = 0; columns.row_count() > i; ++i)
+	{
+		if (flags[i])
+			printf("Row %u flagged: i%d\n", unsigned(i), (&columns.instance_at(i) == objects[2]) ? 3 : (&columns.instance_at(i) == objects[3]) ? 4 : 0);
+	}
+	std::fill_n(flags, columns.row_count(), 0);
+	std::fill_n(columns.column<0>(), columns.row_count(), 0);
+	printf("After reset: i2->count(5): returned %d, i4->count(0): returned %d\n", i2->count(5), i4->count(0));
+}
+
+
+
+using replica_extender = util::dynamic_derived_class<counter_base, void, 1>;
+
+int MAME_ABI_CXX_MEMBER_CALL replica_add_override(replica_extender::type &, int i)
+{
+	return i + 1;
+}
+
+int MAME_ABI_CXX_MEMBER_CALL replica_subtract_override(replica_extender::type &, int i)
+{
+	return i - 1;
+}
+
+void replica_test()
+{
+	printf("Testing virtual table replicas\n");
+
+	std::size_t const groups = util::dynamic_replica_group_count();
+	printf("dynamic_replica_group_count(): %u (%s)\n", unsigned(groups), (1 < groups) ? "replicas per NUMA node" : "single node, replicas disabled by default");
+
+	printf("Creating extension class replicated with 2 replicas and overriding count(int)\n");
+	replica_extender extender("replicated");
+	extender.set_replica_count(2);
+	printf("extender.replica_count(): %u\n", unsigned(extender.replica_count()));
+	extender.override_member_function(&counter_base::count, &replica_add_override);
+
+	printf("Creating instance i1 in replica group 0 and instance i2 in replica group 1\n");
+	replica_extender::type *object;
+	util::set_dynamic_replica_group(0);
+	auto const i1 = extender.instantiate(object);
+	util::set_dynamic_replica_group(1);
+	auto const i2 = extender.instantiate(object);
+	counter_base *const p1 = i1.get(), *const p2 = i2.get();
+	printf("extender.is_instance(*i1): %s, extender.is_instance(*i2): %s\n", extender.is_instance(*i1) ? "yes" : "no", extender.is_instance(*i2) ? "yes" : "no");
+	printf("i1 and i2 share a virtual table: %s\n", (*reinterpret_cast<void **>(p1) == *reinterpret_cast<void **>(p2)) ? "yes" : "no");
+	printf("i1->count(10): returned %d, i2->count(10): returned %d\n", p1->count(10), p2->count(10));
+
+	printf("Overriding count(int) with subtract\n");
+	extender.override_member_function(&counter_base::count, &replica_subtract_override);
+	printf("Before refresh: i1->count(10): returned %d, i2->count(10): returned %d\n", p1->count(10), p2->count(10));
+	printf("Refreshing replica group 1\n");
+	extender.refresh_replica();
+	printf("After refresh: i1->count(10): returned %d, i2->count(10): returned %d\n", p1->count(10), p2->count(10));
+	util::set_dynamic_replica_group(0);
+	extender.refresh_replica();
+	util::set_dynamic_replica_group(util::dynamic_replica_group_auto);
+	printf("After refreshing group 0: i1->count(10): returned %d\n", p1->count(10));
+
+	printf("Restoring count(int)\n");
+	extender.restore_base_member_function(&counter_base::count);
+	util::set_dynamic_replica_group(1);
+	extender.refresh_replica();
+	util::set_dynamic_replica_group(util::dynamic_replica_group_auto);
+	printf("i2->count(10): returned %d\n", p2->count(10));
+
+	printf("Overriding count(int) and refreshing all replicas\n");
+	extender.override_member_function(&counter_base::count, &replica_add_override);
+	extender.refresh_replicas();
+	printf("i1->count(10): returned %d, i2->count(10): returned %d\n", p1->count(10), p2->count(10));
+
+	printf("Changing replica count to 4 with instances using replicas\n");
+	try
+	{
+		extender.set_replica_count(4);
+		printf("Changed replica count (unexpected)\n");
+	}
+	catch (std::runtime_error const &e)
+	{
+		printf("Caught exception: %s\n", e.what());
+	}
+	printf("extender.replica_count(): %u\n", unsigned(extender.replica_count()));
 }
 
 } // anonymous namespace
@@ -270,6 +1205,42 @@ int main(int argc, char *argv[])
 	class_referencing_extender_test();
 	printf("\n");
 	non_virtual_destructor_test();
+	printf("\n");
+	exemplar_test();
+	printf("\n");
+	concurrent_instantiate_test();
+	printf("\n");
+	batch_invoke_test();
+	printf("\n");
+	layout_test();
+	printf("\n");
+	runtime_count_test();
+	printf("\n");
+	profile_test();
+	printf("\n");
+	layered_test();
+	printf("\n");
+	secondary_base_test();
+	printf("\n");
+	tracked_test();
+	printf("\n");
+	reference_test();
+	printf("\n");
+	static_class_test();
+	printf("\n");
+	stats_test();
+	printf("\n");
+	journal_test();
+	printf("\n");
+	error_code_test();
+	printf("\n");
+	override_module_test();
+	printf("\n");
+	override_cache_test();
+	printf("\n");
+	columns_test();
+	printf("\n");
+	replica_test();
 
 	return 0;
 }
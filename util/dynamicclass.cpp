@@ -2,15 +2,240 @@
 // copyright-holders:Vas Crabb
 #include "dynamicclass.ipp"
 
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <locale>
 #include <new>
 #include <sstream>
+#include <thread>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 
 namespace util {
 
+namespace {
+
+#if MAME_DYNAMIC_CLASS_STATS
+
+/// \brief Registry of dynamic derived classes for statistics
+///
+/// Tracks live dynamic derived classes so statistics can be aggregated,
+/// and accumulates counters from classes that have been destroyed.
+struct stats_registry
+{
+	std::mutex mutex;                                           ///< Protects classes and retired counters
+	std::vector<detail::dynamic_derived_class_base const *> classes; ///< Live dynamic derived classes
+	dynamic_derived_class_stats retired;                        ///< Counters from destroyed classes
+	std::size_t classes_created = 0;                            ///< Number of classes created
+	std::atomic<std::size_t> resolve_calls = 0;                 ///< Number of virtual member functions resolved
+	std::atomic<std::uint64_t> resolve_nanoseconds = 0;         ///< Time spent resolving virtual member functions
+};
+
+stats_registry &get_stats_registry()
+{
+	static stats_registry registry;
+	return registry;
+}
+
+
+/// \brief Time spent resolving a virtual member function
+///
+/// Adds the time elapsed between construction and destruction to the
+/// aggregate statistics.
+class resolve_timer
+{
+public:
+	resolve_timer() : m_start(std::chrono::steady_clock::now()) { }
+
+	~resolve_timer()
+	{
+		auto const elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start);
+		stats_registry &registry = get_stats_registry();
+		registry.resolve_calls.fetch_add(1, std::memory_order_relaxed);
+		registry.resolve_nanoseconds.fetch_add(elapsed.count(), std::memory_order_relaxed);
+	}
+
+private:
+	std::chrono::steady_clock::time_point const m_start;
+};
+
+#endif // MAME_DYNAMIC_CLASS_STATS
+
+
+/// \brief Get journal thread identifier
+///
+/// Gets a small sequential identifier for the calling thread, assigned
+/// the first time the thread records a journal event.
+/// \return The identifier for the calling thread.
+std::uint64_t journal_thread_id()
+{
+	static std::atomic<std::uint64_t> next(1);
+	thread_local std::uint64_t const id = next.fetch_add(1, std::memory_order_relaxed);
+	return id;
+}
+
+
+/// \brief Get replica group selection for thread
+///
+/// Gets the replica group selected for the calling thread, or
+/// \c dynamic_replica_group_auto if it has not been selected or
+/// detected yet.
+/// \return A reference to the replica group for the calling thread.
+std::size_t &thread_replica_group()
+{
+	thread_local std::size_t group = dynamic_replica_group_auto;
+	return group;
+}
+
+
+/// \brief Get NUMA node for calling thread
+///
+/// Gets the NUMA node of the processor the calling thread is running
+/// on.  Only supported on Linux.
+/// \return The NUMA node, or zero if it cannot be determined.
+std::size_t current_numa_node()
+{
+#if defined(__linux__) && defined(SYS_getcpu)
+	unsigned cpu = 0, node = 0;
+	if (!syscall(SYS_getcpu, &cpu, &node, nullptr))
+		return node;
+#endif
+	return 0;
+}
+
+
+/// \brief Append text to buffer
+///
+/// Appends a null-terminated string to a fixed-size buffer without
+/// allocating memory.  Text that does not fit is discarded.
+/// \param [in,out] buffer Start of the buffer.
+/// \param [in,out] length Length of text already in the buffer.
+/// \param [in] size Size of the buffer.
+/// \param [in] text The text to append.
+void append_text(char *buffer, std::size_t &length, std::size_t size, char const *text)
+{
+	while (*text && (size > length))
+		buffer[length++] = *text++;
+}
+
+
+/// \brief Append number to buffer
+///
+/// Appends an unsigned number to a fixed-size buffer without allocating
+/// memory.  Digits that do not fit are discarded.
+/// \param [in,out] buffer Start of the buffer.
+/// \param [in,out] length Length of text already in the buffer.
+/// \param [in] size Size of the buffer.
+/// \param [in] value The number to append.
+/// \param [in] radix Base to format the number in, either 10 or 16.
+void append_number(char *buffer, std::size_t &length, std::size_t size, std::uint64_t value, unsigned radix)
+{
+	char digits[20];
+	std::size_t count = 0;
+	do
+	{
+		digits[count++] = "0123456789abcdef"[value % radix];
+		value /= radix;
+	}
+	while (value);
+	while (count && (size > length))
+		buffer[length++] = digits[--count];
+}
+
+
+/// \brief Dynamic derived class error category
+///
+/// Supplies names and messages for \c dynamic_class_error values.  The
+/// messages match the exceptions thrown when error codes are not
+/// requested.
+class dynamic_class_error_category : public std::error_category
+{
+public:
+	virtual char const *name() const noexcept override
+	{
+		return "dynamic_class";
+	}
+
+	virtual std::string message(int condition) const override
+	{
+		switch (dynamic_class_error(condition))
+		{
+		case dynamic_class_error::INVALID_CLASS_NAME:
+			return "Invalid class name";
+		case dynamic_class_error::NOT_VIRTUAL:
+			return "Not a pointer to a virtual member function";
+		case dynamic_class_error::UNSUPPORTED_MEMBER_FUNCTION:
+			return "Not a supported pointer to a virtual member function";
+		case dynamic_class_error::THIS_POINTER_ADJUSTMENT:
+			return "Member function requires this pointer adjustment";
+		case dynamic_class_error::INVALID_VIRTUAL_INDEX:
+			return "Invalid member function virtual table index";
+		case dynamic_class_error::VIRTUAL_INDEX_OUT_OF_RANGE:
+			return "Member function virtual table index out of range";
+		case dynamic_class_error::UNSUPPORTED_ARCHITECTURE:
+			return "Unsupported architecture";
+		case dynamic_class_error::VIRTUAL_COUNT_MISMATCH:
+			return "Virtual member function count does not match template argument";
+		case dynamic_class_error::INVALID_EXEMPLAR:
+			return "Exemplar is not an instance of the base class";
+		case dynamic_class_error::SECONDARY_BASE_NOT_ADDED:
+			return "Secondary base class has not been added";
+		case dynamic_class_error::INVALID_SECONDARY_BASE:
+			return "Secondary base class shares primary virtual table or has already been added";
+		case dynamic_class_error::LAYERED_SECONDARY_BASE:
+			return "Layered classes are not supported for base classes with secondary virtual tables";
+		case dynamic_class_error::BASE_VTABLE_CAPTURED:
+			return "Base class virtual table has already been captured";
+		case dynamic_class_error::SECONDARY_BASE_MISMATCH:
+			return "Target class has different secondary base classes";
+		case dynamic_class_error::REFERENCE_COUNTING_DISABLED:
+			return "Reference counting is not enabled";
+		case dynamic_class_error::NOT_IN_PROFILE:
+			return "Class has not been saved in profile";
+		case dynamic_class_error::MODULE_NOT_LOADED:
+			return "Override module could not be loaded";
+		case dynamic_class_error::SYMBOL_NOT_FOUND:
+			return "Override function not found in module";
+		case dynamic_class_error::INVALID_CACHE:
+			return "Override cache file is invalid";
+		case dynamic_class_error::NOT_IN_CACHE:
+			return "Class has not been saved in override cache";
+		case dynamic_class_error::UNNAMED_OVERRIDE:
+			return "Overriding function has no exported symbol name";
+		case dynamic_class_error::SECONDARY_OVERRIDE:
+			return "Secondary base class member function overrides cannot be saved";
+		case dynamic_class_error::REPLICAS_IN_USE:
+			return "Virtual table replicas are in use by instances";
+		}
+		return "Unknown error";
+	}
+};
+
+} // anonymous namespace
+
+
+/// \brief Get dynamic derived class error category
+///
+/// Gets the error category used for error codes reported by dynamic
+/// derived class operations.
+/// \return A reference to the error category.
+std::error_category const &dynamic_class_category() noexcept
+{
+	static dynamic_class_error_category const category;
+	return category;
+}
+
+
 namespace detail {
 
+dynamic_derived_class_base::stat_counters dynamic_derived_class_base::s_total_stats;
+
 /// \brief Complete object locator equivalent structure
 ///
 /// Structure used for locating the complete object and type information
@@ -50,19 +275,36 @@ struct dynamic_derived_class_base::msvc_type_info_equiv
 /// \param [in] name The name for the dynamic class.  Components must
 ///   start with an alphabetic character or an underscore, and may
 ///   contain only alphanumeric characters and underscores.
+/// \param [in] first_overridable Number of virtual table entries used
+///   for the virtual destructor, in terms of the size of a virtual
+///   member function in the virtual table.
+/// \param [in] virtual_count Number of overridable virtual member
+///   functions.
 /// \exception std::invalid_argument Thrown if the class name is invalid
 ///   or unsupported.
 /// \exception std::bad_alloc Thrown if allocating memory for the type
 ///   info fails.
-dynamic_derived_class_base::dynamic_derived_class_base(std::string_view name) :
-	m_base_vtable(nullptr)
+dynamic_derived_class_base::dynamic_derived_class_base(
+		std::string_view name,
+		std::size_t first_overridable,
+		std::size_t virtual_count) :
+	m_base_vtable(nullptr),
+	m_root_vtable(nullptr),
+	m_base_vtable_ready(false),
+	m_features(nullptr),
+	m_vtable(nullptr),
+	m_overridden(nullptr),
+	m_first_overridable(first_overridable),
+	m_virtual_count(virtual_count)
 {
 	assert(!reinterpret_cast<void *>(std::uintptr_t(static_cast<void (*)()>(nullptr))));
 	assert(!reinterpret_cast<void (*)()>(std::uintptr_t(static_cast<void *>(nullptr))));
 
+	std::error_code const err = validate_name(name);
+	if (err)
+		throw_error(err);
+
 	std::locale const &clocale(std::locale::classic());
-	if (name.empty() || (('_' != name[0]) && !std::isalpha(name[0], clocale)) || (std::find_if_not(name.begin(), name.end(), [&clocale] (char c) { return (':' == c) || ('_' == c) || std::isalnum(c, clocale); }) != name.end()))
-		throw std::invalid_argument("Invalid class name");
 
 	std::ostringstream str;
 	str.imbue(clocale);
@@ -76,9 +318,6 @@ dynamic_derived_class_base::dynamic_derived_class_base(std::string_view name) :
 	std::string_view::size_type found = name.find(':');
 	while (std::string_view::npos != found)
 	{
-		if (((found + 2) >= name.length()) || (name[found + 1] != ':') || (('_' != name[found + 2]) && !std::isalpha(name[found + 2], clocale)))
-			throw std::invalid_argument("Invalid class name");
-
 		str.write(&name[0], found);
 		str << '@';
 		name.remove_prefix(found + 2);
@@ -96,7 +335,7 @@ dynamic_derived_class_base::dynamic_derived_class_base(std::string_view name) :
 	std::copy_n(mangled.c_str(), mangled.length() + 1, m_type_info->decorated);
 #else
 	class base { };
-	class derived : base { };
+	class derived : public base { };
 
 	m_type_info.vptr = *reinterpret_cast<void const *const *>(&typeid(derived));
 
@@ -106,9 +345,6 @@ dynamic_derived_class_base::dynamic_derived_class_base(std::string_view name) :
 		str << 'N';
 	while (std::string_view::npos != found)
 	{
-		if (((found + 2) >= name.length()) || (name[found + 1] != ':') || (('_' != name[found + 2]) && !std::isalpha(name[found + 2], clocale)))
-			throw std::invalid_argument("Invalid class name");
-
 		str << found;
 		str.write(&name[0], found);
 		name.remove_prefix(found + 2);
@@ -121,17 +357,125 @@ dynamic_derived_class_base::dynamic_derived_class_base(std::string_view name) :
 
 	m_type_info.name = m_name.c_str();
 #endif
+
+#if MAME_DYNAMIC_CLASS_STATS
+	// statistics counters live in the optional feature state
+	auto features = std::make_unique<feature_state>();
+	stats_registry &registry = get_stats_registry();
+	std::lock_guard<std::mutex> guard(registry.mutex);
+	registry.classes.emplace_back(this);
+	++registry.classes_created;
+	m_features.store(features.release(), std::memory_order_release);
+#endif
 }
 
 
 dynamic_derived_class_base::~dynamic_derived_class_base()
 {
+#if MAME_DYNAMIC_CLASS_STATS
+	{
+		stats_registry &registry = get_stats_registry();
+		std::lock_guard<std::mutex> guard(registry.mutex);
+		stat_counters const &stats = m_features.load(std::memory_order_relaxed)->stats;
+		registry.classes.erase(std::find(registry.classes.begin(), registry.classes.end(), this));
+		registry.retired.instances_created += stats.instances_created.load(std::memory_order_relaxed);
+		registry.retired.instances_destroyed += stats.instances_destroyed.load(std::memory_order_relaxed);
+		registry.retired.overrides += stats.overrides.load(std::memory_order_relaxed);
+		registry.retired.restores += stats.restores.load(std::memory_order_relaxed);
+		++registry.retired.classes_destroyed;
+	}
+#endif
+
+	std::unique_ptr<feature_state> const state(m_features.load(std::memory_order_acquire));
+	if (state)
+	{
+		assert(state->children.empty());
+		assert(&state->instances == state->instances.next);
+		assert(1 >= state->references);
+		assert(1 >= state->active_shards.load(std::memory_order_relaxed));
+		if (state->parent)
+		{
+			auto &siblings = state->parent->features()->children;
+			siblings.erase(std::find(siblings.begin(), siblings.end(), this));
+		}
+	}
 #if MAME_ABI_CXX_TYPE == MAME_ABI_CXX_MSVC
 	operator delete (m_type_info, std::align_val_t(alignof(msvc_type_info_equiv)));
 #endif
 }
 
 
+/// \brief Get optional feature state, allocating it if necessary
+///
+/// Gets the state used by optional features, allocating it the first
+/// time a feature is enabled.  If multiple threads allocate the state
+/// concurrently, one allocation is published and the others are freed.
+/// \return A reference to the optional feature state.
+/// \exception std::bad_alloc Thrown if allocating memory for the state
+///   fails.
+dynamic_derived_class_base::feature_state &dynamic_derived_class_base::require_features()
+{
+	feature_state *result = m_features.load(std::memory_order_acquire);
+	if (!result)
+	{
+		auto created = std::make_unique<feature_state>();
+		if (m_features.compare_exchange_strong(result, created.get(), std::memory_order_acq_rel, std::memory_order_acquire))
+			result = created.release();
+	}
+	return *result;
+}
+
+
+/// \brief Report an error
+///
+/// Throws an exception corresponding to an error code.  If exceptions
+/// are disabled, terminates the program instead.
+/// \param [in] err The error code.  Must indicate an error.
+/// \exception std::runtime_error Thrown if the target architecture is
+///   not supported, or the base class virtual table has already been
+///   captured.
+/// \exception std::invalid_argument Thrown for other errors.
+void dynamic_derived_class_base::throw_error(std::error_code const &err)
+{
+	assert(err);
+#if MAME_DYNAMIC_CLASS_EXCEPTIONS
+	if ((dynamic_class_error::UNSUPPORTED_ARCHITECTURE == err) || (dynamic_class_error::BASE_VTABLE_CAPTURED == err) || (dynamic_class_error::REPLICAS_IN_USE == err))
+		throw std::runtime_error(err.message());
+	else
+		throw std::invalid_argument(err.message());
+#else
+	std::fprintf(stderr, "%s\n", err.message().c_str());
+	std::abort();
+#endif
+}
+
+
+/// \brief Check class name
+///
+/// Checks that a class name is valid and supported.  The name must be
+/// a non-empty sequence of identifiers separated by \c ::, where each
+/// identifier starts with an alphabetic character or an underscore, and
+/// contains only alphanumeric characters and underscores.
+/// \param [in] name The unmangled class name.
+/// \return An error code if the class name is invalid or unsupported.
+std::error_code dynamic_derived_class_base::validate_name(std::string_view name) noexcept
+{
+	std::locale const &clocale(std::locale::classic());
+	auto const identifier_start = [&clocale] (char c) { return ('_' == c) || std::isalpha(c, clocale); };
+	if (name.empty() || !identifier_start(name[0]) || (std::find_if_not(name.begin(), name.end(), [&clocale] (char c) { return (':' == c) || ('_' == c) || std::isalnum(c, clocale); }) != name.end()))
+		return dynamic_class_error::INVALID_CLASS_NAME;
+
+	std::string_view::size_type found = name.find(':');
+	while (std::string_view::npos != found)
+	{
+		if (((found + 2) >= name.length()) || (name[found + 1] != ':') || !identifier_start(name[found + 2]))
+			return dynamic_class_error::INVALID_CLASS_NAME;
+		found = name.find(':', found + 2);
+	}
+	return std::error_code();
+}
+
+
 /// \brief Get virtual table index for member function
 ///
 /// Gets the virtual table index represented by a pointer to a virtual
@@ -142,17 +486,22 @@ dynamic_derived_class_base::~dynamic_derived_class_base()
 ///   member function.  May be modified.
 /// \param [in] size Size of the member function pointer type for the
 ///   \p slot argument.
-/// \return The virtual table index of the member function, in terms of
-///   the size of a virtual member function in the virtual table.
-/// \exception std::invalid_argument Thrown if the \p slot argument is
-///   not a supported virtual member function.
-std::size_t dynamic_derived_class_base::resolve_virtual_member_slot(
+/// \param [out] index Receives the virtual table index of the member
+///   function, in terms of the size of a virtual member function in the
+///   virtual table.
+/// \return An error code if the \p slot argument is not a supported
+///   virtual member function.
+std::error_code dynamic_derived_class_base::try_resolve_virtual_member_slot(
 		member_function_pointer_equiv &slot,
-		std::size_t size)
+		std::size_t size,
+		std::size_t &index) noexcept
 {
+#if MAME_DYNAMIC_CLASS_STATS
+	resolve_timer const timer;
+#endif
 #if MAME_ABI_CXX_TYPE == MAME_ABI_CXX_MSVC
 	if ((sizeof(msvc_mi_member_function_pointer_equiv) <= size) && slot.adj)
-		throw std::invalid_argument("Member function requires this pointer adjustment");
+		return dynamic_class_error::THIS_POINTER_ADJUSTMENT;
 #if defined(__x86_64__) || defined(_M_X64)
 	std::uint8_t const *func = reinterpret_cast<std::uint8_t const *>(slot.ptr);
 	while (0xe9 == func[0]) // relative jump with 32-bit displacement (typically a resolved PLT entry)
@@ -164,21 +513,24 @@ std::size_t dynamic_derived_class_base::resolve_virtual_member_slot(
 			// MSVC virtual function call thunk - mov rax,QWORD PTR [rcx] ; jmp QWORD PTR [rax+...]
 			if (0x20 == func[4]) // no displacement
 			{
-				return 0;
+				index = 0;
+				return std::error_code();
 			}
 			else if (0x60 == func[4]) // 8-bit displacement
 			{
-				auto const index = *reinterpret_cast<std::int8_t const *>(func + 5);
-				if (index % (sizeof(std::uintptr_t) * MEMBER_FUNCTION_SIZE))
-					throw std::invalid_argument("Invalid member function virtual table index");
-				return index / sizeof(std::uintptr_t) / MEMBER_FUNCTION_SIZE;
+				auto const displacement = *reinterpret_cast<std::int8_t const *>(func + 5);
+				if (displacement % (sizeof(std::uintptr_t) * MEMBER_FUNCTION_SIZE))
+					return dynamic_class_error::INVALID_VIRTUAL_INDEX;
+				index = displacement / sizeof(std::uintptr_t) / MEMBER_FUNCTION_SIZE;
+				return std::error_code();
 			}
 			else // 32-bit displacement
 			{
-				auto const index = *reinterpret_cast<std::int32_t const *>(func + 5);
-				if (index % (sizeof(std::uintptr_t) * MEMBER_FUNCTION_SIZE))
-					throw std::invalid_argument("Invalid member function virtual table index");
-				return index / sizeof(std::uintptr_t) / MEMBER_FUNCTION_SIZE;
+				auto const displacement = *reinterpret_cast<std::int32_t const *>(func + 5);
+				if (displacement % (sizeof(std::uintptr_t) * MEMBER_FUNCTION_SIZE))
+					return dynamic_class_error::INVALID_VIRTUAL_INDEX;
+				index = displacement / sizeof(std::uintptr_t) / MEMBER_FUNCTION_SIZE;
+				return std::error_code();
 			}
 		}
 		else if ((0x48 == func[3]) && (0x8b == func[4]))
@@ -187,43 +539,1460 @@ std::size_t dynamic_derived_class_base::resolve_virtual_member_slot(
 			if  ((0x00 == func[5]) && (0x48 == func[6]) && (0xff == func[7]) && (0xe0 == func[8]))
 			{
 				// no displacement
-				return 0;
+				index = 0;
+				return std::error_code();
 			}
 			else if  ((0x40 == func[5]) && (0x48 == func[7]) && (0xff == func[8]) && (0xe0 == func[9]))
 			{
 				// 8-bit displacement
-				auto const index = *reinterpret_cast<std::int8_t const *>(func + 6);
-				if (index % (sizeof(std::uintptr_t) * MEMBER_FUNCTION_SIZE))
-					throw std::invalid_argument("Invalid member function virtual table index");
-				return index / sizeof(std::uintptr_t) / MEMBER_FUNCTION_SIZE;
+				auto const displacement = *reinterpret_cast<std::int8_t const *>(func + 6);
+				if (displacement % (sizeof(std::uintptr_t) * MEMBER_FUNCTION_SIZE))
+					return dynamic_class_error::INVALID_VIRTUAL_INDEX;
+				index = displacement / sizeof(std::uintptr_t) / MEMBER_FUNCTION_SIZE;
+				return std::error_code();
 			}
 			else if ((0x80 == func[5]) && (0x48 == func[10]) && (0xff == func[11]) && (0xe0 == func[12]))
 			{
 				// 32-bit displacement
-				auto const index = *reinterpret_cast<std::int32_t const *>(func + 6);
-				if (index % (sizeof(std::uintptr_t) * MEMBER_FUNCTION_SIZE))
-					throw std::invalid_argument("Invalid member function virtual table index");
-				return index / sizeof(std::uintptr_t) / MEMBER_FUNCTION_SIZE;
+				auto const displacement = *reinterpret_cast<std::int32_t const *>(func + 6);
+				if (displacement % (sizeof(std::uintptr_t) * MEMBER_FUNCTION_SIZE))
+					return dynamic_class_error::INVALID_VIRTUAL_INDEX;
+				index = displacement / sizeof(std::uintptr_t) / MEMBER_FUNCTION_SIZE;
+				return std::error_code();
 			}
 		}
 	}
-	throw std::invalid_argument("Not a supported pointer to a virtual member function");
+	return dynamic_class_error::UNSUPPORTED_MEMBER_FUNCTION;
 #else
-	throw std::runtime_error("Unsupported architecture");
+	return dynamic_class_error::UNSUPPORTED_ARCHITECTURE;
 #endif
 #else
 	if (!slot.is_virtual())
-		throw std::invalid_argument("Not a pointer to a virtual member function");
+		return dynamic_class_error::NOT_VIRTUAL;
 	if (slot.this_pointer_offset())
-		throw std::invalid_argument("Member function requires this pointer adjustment");
+		return dynamic_class_error::THIS_POINTER_ADJUSTMENT;
 	if (MAME_ABI_CXX_ITANIUM_MFP_TYPE == MAME_ABI_CXX_ITANIUM_MFP_STANDARD)
 		slot.ptr -= 1;
 	if (slot.ptr % (sizeof(std::uintptr_t) * MEMBER_FUNCTION_SIZE))
-		throw std::invalid_argument("Invalid member function virtual table index");
-	return slot.ptr / sizeof(std::uintptr_t) / MEMBER_FUNCTION_SIZE;
+		return dynamic_class_error::INVALID_VIRTUAL_INDEX;
+	index = slot.ptr / sizeof(std::uintptr_t) / MEMBER_FUNCTION_SIZE;
+	return std::error_code();
+#endif
+}
+
+
+/// \brief Get virtual table index for member function
+///
+/// Gets the virtual table index represented by a pointer to a virtual
+/// member function.  See \c try_resolve_virtual_member_slot for
+/// details.
+/// \param [in] slot Internal representation of pointer to a virtual
+///   member function.  May be modified.
+/// \param [in] size Size of the member function pointer type for the
+///   \p slot argument.
+/// \return The virtual table index of the member function, in terms of
+///   the size of a virtual member function in the virtual table.
+/// \exception std::invalid_argument Thrown if the \p slot argument is
+///   not a supported virtual member function.
+std::size_t dynamic_derived_class_base::resolve_virtual_member_slot(
+		member_function_pointer_equiv &slot,
+		std::size_t size)
+{
+	std::size_t index;
+	std::error_code const err = try_resolve_virtual_member_slot(slot, size, index);
+	if (err)
+		throw_error(err);
+	return index;
+}
+
+
+/// \brief Set virtual table storage
+///
+/// Sets the storage used for the virtual table and overridden member
+/// function flags.  Must be called before the virtual table is
+/// initialised or copied.
+/// \param [in] storage Pointer to storage with space for the number of
+///   entries returned by \c storage_size.
+void dynamic_derived_class_base::set_storage(std::uintptr_t *storage)
+{
+	m_vtable = storage;
+	m_overridden = &storage[VTABLE_PREFIX_ENTRIES + ((m_first_overridable + m_virtual_count) * MEMBER_FUNCTION_SIZE)];
+}
+
+
+/// \brief Initialise virtual table
+///
+/// Sets the virtual table entries preceding the member functions, sets
+/// the entries for overridable member functions to null pointers, and
+/// clears all overridden member function flags.  Entries for the
+/// virtual destructor are not modified.
+void dynamic_derived_class_base::init_vtable()
+{
+#if MAME_ABI_CXX_TYPE == MAME_ABI_CXX_MSVC
+	m_vtable[0] = std::uintptr_t(&m_base_vtable); // for restoring the base vtable
+#else
+	m_vtable[0] = 0; // offset to top
+	m_vtable[1] = std::uintptr_t(&m_type_info); // type info
+#endif
+	std::fill(
+			&m_vtable[VTABLE_PREFIX_ENTRIES + (m_first_overridable * MEMBER_FUNCTION_SIZE)],
+			m_overridden,
+			std::uintptr_t(static_cast<void *>(nullptr)));
+	std::fill_n(
+			m_overridden,
+			(m_virtual_count + OVERRIDDEN_FLAGS_PER_ENTRY - 1) / OVERRIDDEN_FLAGS_PER_ENTRY,
+			std::uintptr_t(0));
+}
+
+
+/// \brief Copy virtual table from prototype
+///
+/// Copies the virtual table, overridden member function flags and saved
+/// base class virtual table pointer from a prototype, and updates the
+/// entries that refer to the dynamic derived class itself.
+/// \param [in] prototype The dynamic derived class to copy from.  Must
+///   have the same base class and extra data type.
+void dynamic_derived_class_base::copy_vtable(dynamic_derived_class_base const &prototype)
+{
+	assert(m_first_overridable == prototype.m_first_overridable);
+	assert(m_virtual_count == prototype.m_virtual_count);
+	m_base_vtable.store(prototype.m_base_vtable.load(std::memory_order_acquire), std::memory_order_relaxed);
+	m_root_vtable.store(prototype.m_root_vtable.load(std::memory_order_acquire), std::memory_order_relaxed);
+	std::copy_n(prototype.m_vtable, storage_size(m_first_overridable, m_virtual_count), m_vtable);
+#if MAME_ABI_CXX_TYPE == MAME_ABI_CXX_MSVC
+	m_vtable[0] = std::uintptr_t(&m_base_vtable); // for restoring the base vtable
+#else
+	m_vtable[1] = std::uintptr_t(&m_type_info); // type info
+#endif
+	feature_state const *const source = prototype.features();
+	if (!source || (!source->parent && source->secondary.empty()))
+		return;
+	feature_state &state = require_features();
+	for (secondary_vtable const &secondary : source->secondary)
+	{
+		std::size_t const size = storage_size(secondary.first_overridable, secondary.virtual_count);
+		secondary_vtable &copy = state.secondary.emplace_back(secondary_vtable{
+				secondary.offset,
+				secondary.first_overridable,
+				secondary.virtual_count,
+				std::make_unique<std::uintptr_t []>(size),
+				secondary.base_vtable });
+		std::copy_n(secondary.vtable.get(), size, copy.vtable.get());
+		copy.vtable[1] = std::uintptr_t(&m_type_info); // type info
+	}
+	if (source->parent)
+	{
+		state.parent = source->parent;
+		state.parent->require_features().children.emplace_back(this);
+	}
+}
+
+
+/// \brief Capture base class virtual table
+///
+/// Saves the base class virtual table pointer, and copies entries for
+/// virtual member functions that have not been overridden to the
+/// dynamic derived class virtual table.  Takes effect once, either on
+/// construction when an exemplar is supplied, or when the first
+/// instance is created.  If multiple threads attempt to capture the
+/// base class virtual table concurrently, one thread performs the
+/// capture and the others wait for it to complete.  The base class
+/// virtual table pointer is published after the dynamic derived class
+/// virtual table has been updated.
+///
+/// For a layered class, the base class virtual table is captured for the
+/// parent class, and entries are propagated from the parent class.  Only
+/// the pointer used to restore the base class virtual table on
+/// destruction is saved for the layered class itself.
+/// \param [in] object Pointer to an instance of the base class.
+void dynamic_derived_class_base::capture_base_vtable(void const *object)
+{
+	std::call_once(
+			m_base_vtable_captured,
+			[this, object] ()
+			{
+				auto const vptr = *reinterpret_cast<std::uintptr_t const *const *>(object);
+				if (MAME_ABI_CXX_TYPE == MAME_ABI_CXX_MSVC)
+					m_vtable[1] = vptr[-1]; // use the base class complete object locator - too hard to fake
+				feature_state *const state = features();
+				if (state && state->parent)
+				{
+					state->parent->capture_base_vtable(object);
+				}
+				else
+				{
+					for (std::size_t i = 0; m_virtual_count > i; ++i)
+					{
+						if (!is_overridden(i))
+						{
+							std::size_t const offset = (i + m_first_overridable) * MEMBER_FUNCTION_SIZE;
+							std::copy_n(vptr + offset, MEMBER_FUNCTION_SIZE, &m_vtable[VTABLE_PREFIX_ENTRIES + offset]);
+							propagate_virtual_member_slot(i + m_first_overridable);
+						}
+					}
+					m_base_vtable.store(vptr, std::memory_order_release);
+				}
+				if (state)
+				{
+					for (secondary_vtable &secondary : state->secondary)
+					{
+						auto const secondary_vptr = *reinterpret_cast<std::uintptr_t const *const *>(
+								reinterpret_cast<std::uint8_t const *>(object) + secondary.offset);
+						std::uintptr_t const *const overridden = &secondary.vtable[VTABLE_PREFIX_ENTRIES + ((secondary.first_overridable + secondary.virtual_count) * MEMBER_FUNCTION_SIZE)];
+						for (std::size_t i = 0; secondary.virtual_count > i; ++i)
+						{
+							if (!((overridden[i / OVERRIDDEN_FLAGS_PER_ENTRY] >> (i % OVERRIDDEN_FLAGS_PER_ENTRY)) & 1))
+							{
+								std::size_t const offset = (i + secondary.first_overridable) * MEMBER_FUNCTION_SIZE;
+								std::copy_n(secondary_vptr + offset, MEMBER_FUNCTION_SIZE, &secondary.vtable[VTABLE_PREFIX_ENTRIES + offset]);
+							}
+						}
+						secondary.base_vtable = secondary_vptr;
+					}
+				}
+				advance_vtable_epoch();
+				m_root_vtable.store(vptr, std::memory_order_release);
+			});
+}
+
+
+/// \brief Set parent class
+///
+/// Makes the dynamic derived class a layered class using another
+/// dynamic derived class as its parent.  Entries for all overridable
+/// member functions are copied from the parent class, and base class
+/// implementations resolve to the parent class implementations.  Must
+/// be called after initialising the virtual table, before any member
+/// functions are overridden.
+/// \param [in] parent The dynamic derived class to use as the parent.
+///   Must have the same base class and virtual member function count.
+/// \exception std::invalid_argument Thrown if secondary base classes
+///   have been added to the parent class.
+/// \exception std::bad_alloc Thrown if allocating memory to record the
+///   layered class fails.
+void dynamic_derived_class_base::set_parent(dynamic_derived_class_base &parent)
+{
+	feature_state const *const parent_state = parent.features();
+	if (parent_state && !parent_state->secondary.empty())
+		throw_error(dynamic_class_error::LAYERED_SECONDARY_BASE);
+	assert(!features() || !features()->parent);
+	assert(m_first_overridable == parent.m_first_overridable);
+	assert(m_virtual_count == parent.m_virtual_count);
+	feature_state &state = require_features();
+	parent.require_features().children.emplace_back(this);
+	state.parent = &parent;
+	if (MAME_ABI_CXX_TYPE == MAME_ABI_CXX_MSVC)
+		m_vtable[1] = parent.m_vtable[1];
+	std::copy_n(
+			&parent.m_vtable[VTABLE_PREFIX_ENTRIES + (m_first_overridable * MEMBER_FUNCTION_SIZE)],
+			m_virtual_count * MEMBER_FUNCTION_SIZE,
+			&m_vtable[VTABLE_PREFIX_ENTRIES + (m_first_overridable * MEMBER_FUNCTION_SIZE)]);
+	m_base_vtable.store(parent.instance_vptr(), std::memory_order_release);
+	m_root_vtable.store(parent.m_root_vtable.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+
+/// \brief Add secondary virtual table
+///
+/// Allocates and initialises a virtual table for a base class of the
+/// base class that does not share the primary virtual table pointer.
+/// The offset to top and type info entries are set, and entries for
+/// overridable member functions are set to null pointers.  Entries for
+/// the virtual destructor are not set.
+///
+/// Only supported for the Itanium C++ ABI.
+/// \param [in] offset Offset to the secondary base class within the
+///   base class in bytes.
+/// \param [in] first_overridable Number of virtual table entries used
+///   for the virtual destructor of the secondary base class, in terms
+///   of the size of a virtual member function in the virtual table.
+/// \param [in] virtual_count Number of overridable virtual member
+///   functions of the secondary base class.
+/// \return A reference to the secondary virtual table.
+/// \exception std::invalid_argument Thrown if the offset is zero or a
+///   secondary base class has already been added at the offset, or if
+///   this is a layered dynamic derived class or has layered classes.
+/// \exception std::runtime_error Thrown if the base class virtual table
+///   has already been captured.
+/// \exception std::bad_alloc Thrown if allocating memory for the
+///   virtual table fails.
+dynamic_derived_class_base::secondary_vtable &dynamic_derived_class_base::add_secondary_vtable(
+		std::ptrdiff_t offset,
+		std::size_t first_overridable,
+		std::size_t virtual_count)
+{
+	feature_state *const existing = features();
+	if (existing && (existing->parent || !existing->children.empty()))
+		throw_error(dynamic_class_error::LAYERED_SECONDARY_BASE);
+	if (m_root_vtable.load(std::memory_order_acquire))
+		throw_error(dynamic_class_error::BASE_VTABLE_CAPTURED);
+	if (!offset || find_secondary_vtable(offset))
+		throw_error(dynamic_class_error::INVALID_SECONDARY_BASE);
+
+	std::size_t const size = storage_size(first_overridable, virtual_count);
+	secondary_vtable &result = require_features().secondary.emplace_back(secondary_vtable{
+			offset,
+			first_overridable,
+			virtual_count,
+			std::make_unique<std::uintptr_t []>(size),
+			nullptr });
+	result.vtable[0] = std::uintptr_t(-offset); // offset to top
+	result.vtable[1] = std::uintptr_t(&m_type_info); // type info
+	std::fill(
+			&result.vtable[VTABLE_PREFIX_ENTRIES + (first_overridable * MEMBER_FUNCTION_SIZE)],
+			&result.vtable[VTABLE_PREFIX_ENTRIES + ((first_overridable + virtual_count) * MEMBER_FUNCTION_SIZE)],
+			std::uintptr_t(static_cast<void *>(nullptr)));
+	std::fill(
+			&result.vtable[VTABLE_PREFIX_ENTRIES + ((first_overridable + virtual_count) * MEMBER_FUNCTION_SIZE)],
+			&result.vtable[size],
+			std::uintptr_t(0));
+	return result;
+}
+
+
+/// \brief Set secondary virtual table pointers
+///
+/// Sets the secondary virtual table pointers in an instance to point
+/// to the dynamic derived class secondary virtual tables.
+/// \param [in] object Pointer to the base class member of an instance.
+void dynamic_derived_class_base::set_secondary_vptrs(void *object) const
+{
+	feature_state const *const state = features();
+	if (!state)
+		return;
+	for (secondary_vtable const &secondary : state->secondary)
+		*reinterpret_cast<std::uintptr_t const **>(reinterpret_cast<std::uint8_t *>(object) + secondary.offset) = secondary.instance_vptr();
+}
+
+
+/// \brief Add instance to list
+///
+/// Adds a newly created instance to the end of the list of instances
+/// of the dynamic derived class.  Locks the list, so concurrent calls
+/// for the same class are serialised.
+/// \param [in,out] link The instance link of the new instance.
+void dynamic_derived_class_base::link_instance(instance_link &link)
+{
+	feature_state &state = *features();
+	std::lock_guard<std::mutex> guard(state.instances_mutex);
+	link.prev = state.instances.prev;
+	link.next = &state.instances;
+	state.instances.prev->next = &link;
+	state.instances.prev = &link;
+	link.owner.store(this, std::memory_order_relaxed);
+	++state.instance_count;
+}
+
+
+/// \brief Remove instance from list
+///
+/// Removes an instance from the list of instances of the dynamic
+/// derived class that owns it.  The instance may be moved to another
+/// class concurrently, so the owner is checked again after the owner's
+/// list is locked.
+/// \param [in,out] link The instance link of the instance to remove.
+void dynamic_derived_class_base::unlink_instance(instance_link &link)
+{
+	dynamic_derived_class_base *owner = link.owner.load(std::memory_order_acquire);
+	while (true)
+	{
+		feature_state &state = *owner->features();
+		std::lock_guard<std::mutex> guard(state.instances_mutex);
+		dynamic_derived_class_base *const current = link.owner.load(std::memory_order_relaxed);
+		if (current == owner)
+		{
+			link.prev->next = link.next;
+			link.next->prev = link.prev;
+			link.prev = link.next = nullptr;
+			link.owner.store(nullptr, std::memory_order_relaxed);
+			--state.instance_count;
+			return;
+		}
+		owner = current;
+	}
+}
+
+
+/// \brief Move all instances to another class
+///
+/// Sets the virtual table pointers of all instances of the dynamic
+/// derived class to point to the virtual tables of the target class,
+/// and moves the instances to the end of the target class's list.  If
+/// the target class has not captured the base class virtual table yet,
+/// it is captured from this class.
+/// \param [in] target The dynamic derived class to move instances to.
+///   Must have the same base class and extra data type.
+/// \param [in] link_offset Offset from the start of an instance to its
+///   instance link in bytes.
+/// \return The number of instances moved.
+/// \exception std::invalid_argument Thrown if the target class has
+///   different secondary base classes.
+std::size_t dynamic_derived_class_base::retarget_instances(
+		dynamic_derived_class_base &target,
+		std::ptrdiff_t link_offset)
+{
+	if (&target == this)
+		return 0;
+	feature_state &state = *features();
+	feature_state &target_state = *target.features();
+	if ((target_state.secondary.size() != state.secondary.size()) || !std::all_of(
+				state.secondary.begin(),
+				state.secondary.end(),
+				[&target] (secondary_vtable const &secondary) { return target.find_secondary_vtable(secondary.offset); }))
+	{
+		throw_error(dynamic_class_error::SECONDARY_BASE_MISMATCH);
+	}
+
+	std::vector<void const *> released;
+	std::unique_lock<std::mutex> lock(state.instances_mutex, std::defer_lock);
+	std::unique_lock<std::mutex> target_lock(target_state.instances_mutex, std::defer_lock);
+	std::lock(lock, target_lock);
+	if (&state.instances == state.instances.next)
+		return 0;
+	if (dynamic_reference_mode::NONE != state.reference_mode)
+		released.reserve(state.instance_count);
+
+	if (!target.m_root_vtable.load(std::memory_order_acquire))
+	{
+		// build an image of the virtual table pointers of a base class instance
+		std::ptrdiff_t size = sizeof(std::uintptr_t);
+		for (secondary_vtable const &secondary : state.secondary)
+			size = (std::max)(size, std::ptrdiff_t(secondary.offset + sizeof(std::uintptr_t)));
+		std::vector<std::uintptr_t const *> image(size / sizeof(std::uintptr_t), nullptr);
+		image[0] = reinterpret_cast<std::uintptr_t const *>(m_root_vtable.load(std::memory_order_acquire));
+		for (secondary_vtable const &secondary : state.secondary)
+			image[secondary.offset / sizeof(std::uintptr_t)] = secondary.base_vtable;
+		target.capture_base_vtable(image.data());
+	}
+
+	std::size_t result = 0;
+	for (instance_link *link = state.instances.next; &state.instances != link; link = link->next)
+	{
+		void *const object = reinterpret_cast<std::uint8_t *>(link) - link_offset;
+		*reinterpret_cast<std::uintptr_t const **>(object) = target.instance_vptr();
+		target.set_secondary_vptrs(object);
+		target.add_instance_reference(object);
+		if (dynamic_reference_mode::NONE != state.reference_mode)
+			released.emplace_back(object);
+		link->owner.store(&target, std::memory_order_relaxed);
+		++result;
+	}
+	state.instances.next->prev = target_state.instances.prev;
+	target_state.instances.prev->next = state.instances.next;
+	state.instances.prev->next = &target_state.instances;
+	target_state.instances.prev = state.instances.prev;
+	state.instances.next = state.instances.prev = &state.instances;
+	target_state.instance_count += result;
+	state.instance_count = 0;
+#if MAME_DYNAMIC_CLASS_STATS
+	state.stats.live_instances.fetch_sub(result, std::memory_order_relaxed);
+	target_state.stats.add_live_instances(result);
+#endif
+
+	// releasing the last reference may destroy this class
+	target_lock.unlock();
+	lock.unlock();
+	for (void const *object : released)
+		release_instance_reference(object);
+	return result;
+}
+
+
+/// \brief Record change in journal
+///
+/// Records an override or restoration of a member function in the
+/// installed journal.  Has no effect if no journal is installed.
+/// \param [in] restore True if the base implementation was restored,
+///   or false if the member function was overridden.
+/// \param [in] offset Offset to the secondary base class, or zero for
+///   the primary virtual table.
+/// \param [in] index Virtual table index of the member function.
+/// \param [in] previous The virtual table entry before the change.
+/// \param [in] current The virtual table entry after the change.
+void dynamic_derived_class_base::journal_change(
+		bool restore,
+		std::ptrdiff_t offset,
+		std::size_t index,
+		std::uintptr_t previous,
+		std::uintptr_t current) const
+{
+	dynamic_derived_class_journal *const journal = dynamic_derived_class_journal::installed();
+	if (journal)
+	{
+		dynamic_derived_class_journal::event e;
+		e.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		e.thread = journal_thread_id();
+		e.restore = restore;
+		e.offset = offset;
+		e.slot = index;
+		e.previous = previous;
+		e.current = current;
+#if MAME_ABI_CXX_TYPE == MAME_ABI_CXX_MSVC
+		char const *const name = m_name.c_str();
+#else
+		char const *const name = m_type_info.name;
+#endif
+		std::size_t const length = (std::min)(std::strlen(name), sizeof(e.class_name) - 1);
+		std::fill(std::copy_n(name, length, e.class_name), std::end(e.class_name), '\0');
+		journal->record(e);
+	}
+}
+
+
+/// \brief Add statistics for class
+///
+/// Adds the counters and memory usage for the dynamic derived class to
+/// the supplied statistics.  Counters are only added if statistics are
+/// enabled.
+/// \param [in,out] stats The statistics to add to.
+void dynamic_derived_class_base::collect_stats(dynamic_derived_class_stats &stats) const
+{
+	feature_state const *const state = features();
+#if MAME_DYNAMIC_CLASS_STATS
+	stats.live_instances += state->stats.live_instances.load(std::memory_order_relaxed);
+	stats.peak_instances += state->stats.peak_instances.load(std::memory_order_relaxed);
+	stats.instances_created += state->stats.instances_created.load(std::memory_order_relaxed);
+	stats.instances_destroyed += state->stats.instances_destroyed.load(std::memory_order_relaxed);
+	stats.overrides += state->stats.overrides.load(std::memory_order_relaxed);
+	stats.restores += state->stats.restores.load(std::memory_order_relaxed);
+#endif
+	stats.vtable_bytes += storage_size(m_first_overridable, m_virtual_count) * sizeof(std::uintptr_t);
+	if (state)
+	{
+		for (secondary_vtable const &secondary : state->secondary)
+			stats.vtable_bytes += storage_size(secondary.first_overridable, secondary.virtual_count) * sizeof(std::uintptr_t);
+		if (state->replica_count)
+			stats.vtable_bytes += state->replica_count * (((replica_size() + REPLICA_LINE_ENTRIES - 1) / REPLICA_LINE_ENTRIES) + 1) * REPLICA_LINE_ENTRIES * sizeof(std::uintptr_t);
+	}
+	stats.name_bytes += m_name.capacity() + 1;
+#if MAME_ABI_CXX_TYPE == MAME_ABI_CXX_MSVC
+	stats.type_info_bytes += offsetof(msvc_type_info_equiv, decorated) + std::strlen(m_type_info->decorated) + 1;
+#else
+	stats.type_info_bytes += sizeof(m_type_info);
+#endif
+}
+
+
+/// \brief Set instance reference counting mode
+///
+/// Selects how instances hold references to the dynamic derived class.
+/// Allocates the reference count shards for the sharded mode.  Must be
+/// called before any instances are created.
+/// \param [in] mode The reference counting mode.
+/// \exception std::bad_alloc Thrown if allocating memory for the
+///   reference count shards fails.
+void dynamic_derived_class_base::set_reference_mode(dynamic_reference_mode mode)
+{
+	feature_state &state = require_features();
+	assert(!state.reclaim);
+	if ((dynamic_reference_mode::SHARDED == mode) && !state.shards)
+		state.shards = std::make_unique<reference_shard []>(REFERENCE_SHARDS);
+	state.reference_mode = mode;
+}
+
+
+/// \brief Get reference count
+///
+/// Gets the number of references held by instances, plus one if the
+/// owner has not released the class.
+/// \return The number of references, or zero if reference counting is
+///   not enabled.
+std::size_t dynamic_derived_class_base::reference_count() const
+{
+	feature_state const *const state = features();
+	if (!state)
+		return 0;
+	switch (state->reference_mode)
+	{
+	case dynamic_reference_mode::NONE:
+		break;
+	case dynamic_reference_mode::SINGLE_THREAD:
+		return state->references;
+	case dynamic_reference_mode::SHARDED:
+		{
+			std::size_t result = state->reclaim ? 0 : 1;
+			for (std::size_t i = 0; REFERENCE_SHARDS > i; ++i)
+				result += state->shards[i].count.load(std::memory_order_relaxed);
+			return result;
+		}
+	}
+	return 0;
+}
+
+
+/// \brief Release owner reference
+///
+/// Releases the reference held by the owner of the dynamic derived
+/// class.  After this, the class is destroyed when the last reference
+/// held by an instance is released.  If no instances hold references,
+/// the class is destroyed immediately.
+/// \param [in] reclaim Function used to destroy the class.
+/// \exception std::invalid_argument Thrown if reference counting is not
+///   enabled.
+void dynamic_derived_class_base::release_owner_reference(void (*reclaim)(dynamic_derived_class_base &))
+{
+	feature_state *const state = features();
+	if (!state || (dynamic_reference_mode::NONE == state->reference_mode))
+		throw_error(dynamic_class_error::REFERENCE_COUNTING_DISABLED);
+	assert(!state->reclaim);
+	state->reclaim = reclaim;
+	if (dynamic_reference_mode::SINGLE_THREAD == state->reference_mode)
+	{
+		if (!--state->references)
+			reclaim(*this);
+	}
+	else if (1 == state->active_shards.fetch_sub(1, std::memory_order_acq_rel))
+	{
+		reclaim(*this);
+	}
+}
+
+
+/// \brief Set number of virtual table replicas
+///
+/// Allocates copies of the virtual table for replica groups, or frees
+/// them if the count is zero or one.  Each copy is aligned to a cache
+/// line and padded to a whole number of cache lines.  Existing copies
+/// can only be replaced if no instance has been created using them,
+/// as instances hold pointers into them.  Instances created before
+/// replicas were enabled use the class's virtual table, which is not
+/// affected.  Must not be called concurrently with creating instances.
+/// \param [in] count The number of replicas.
+/// \return An error code if an instance has been created using the
+///   existing replicas.
+/// \exception std::bad_alloc Thrown if allocating memory for the
+///   replicas fails.
+std::error_code dynamic_derived_class_base::set_replica_count(std::size_t count)
+{
+	feature_state *const existing = features();
+	if (existing && existing->replicas_used.load(std::memory_order_relaxed))
+		return dynamic_class_error::REPLICAS_IN_USE;
+	if (1 >= count)
+	{
+		if (existing)
+		{
+			existing->replicas.reset();
+			existing->replica_count = 0;
+		}
+		return std::error_code();
+	}
+
+	feature_state &state = require_features();
+
+	std::size_t const lines = (replica_size() + REPLICA_LINE_ENTRIES - 1) / REPLICA_LINE_ENTRIES;
+	auto replicas = std::make_unique<vtable_replica []>(count);
+	for (std::size_t i = 0; count > i; ++i)
+	{
+		vtable_replica &replica = replicas[i];
+		std::size_t space = (lines + 1) * REPLICA_LINE_ENTRIES * sizeof(std::uintptr_t);
+		replica.storage = std::make_unique<std::uintptr_t []>(space / sizeof(std::uintptr_t));
+		void *start = replica.storage.get();
+		replica.vtable = reinterpret_cast<std::uintptr_t *>(std::align(
+				REPLICA_LINE_ENTRIES * sizeof(std::uintptr_t),
+				lines * REPLICA_LINE_ENTRIES * sizeof(std::uintptr_t),
+				start,
+				space));
+		assert(replica.vtable);
+		std::uint64_t const epoch = state.vtable_epoch.load(std::memory_order_acquire);
+		std::copy_n(m_vtable, replica_size(), replica.vtable);
+		replica.epoch.store(epoch, std::memory_order_relaxed);
+	}
+	state.replicas = std::move(replicas);
+	state.replica_count = count;
+	return std::error_code();
+}
+
+
+/// \brief Get virtual table pointer for new instance
+///
+/// Brings the virtual table replica for the calling thread's replica
+/// group up to date, and gets the virtual table pointer for instances
+/// using it.  Must only be called if virtual table replicas are
+/// enabled.
+/// \return Pointer to the first virtual member function entry in the
+///   replica for the calling thread.
+std::uintptr_t const *dynamic_derived_class_base::replica_vptr()
+{
+	feature_state &state = *features();
+	assert(state.replica_count);
+	vtable_replica &replica = state.replicas[current_dynamic_replica_group() % state.replica_count];
+	refresh_replica(replica);
+	if (!state.replicas_used.load(std::memory_order_relaxed))
+		state.replicas_used.store(true, std::memory_order_relaxed);
+	return replica.instance_vptr();
+}
+
+
+/// \brief Refresh replica for calling thread
+///
+/// Brings the virtual table replica for the calling thread's replica
+/// group up to date.  Has no effect if virtual table replicas are not
+/// enabled.
+void dynamic_derived_class_base::refresh_replica()
+{
+	feature_state *const state = features();
+	if (state && state->replica_count)
+		refresh_replica(state->replicas[current_dynamic_replica_group() % state->replica_count]);
+}
+
+
+/// \brief Refresh all replicas
+///
+/// Brings the virtual table replicas for all replica groups up to date.
+/// Has no effect if virtual table replicas are not enabled.
+void dynamic_derived_class_base::refresh_replicas()
+{
+	feature_state *const state = features();
+	for (std::size_t i = 0; state && (state->replica_count > i); ++i)
+		refresh_replica(state->replicas[i]);
+}
+
+
+/// \brief Check for replica virtual table pointer
+///
+/// Checks whether a virtual table pointer refers to one of the virtual
+/// table replicas.
+/// \param [in] vptr The virtual table pointer to check.
+/// \return True if the virtual table pointer refers to a replica, or
+///   false otherwise.
+bool dynamic_derived_class_base::is_replica_vptr(std::uintptr_t vptr) const
+{
+	feature_state const *const state = features();
+	for (std::size_t i = 0; state && (state->replica_count > i); ++i)
+	{
+		if (std::uintptr_t(state->replicas[i].instance_vptr()) == vptr)
+			return true;
+	}
+	return false;
+}
+
+
+/// \brief Refresh virtual table replica
+///
+/// Copies the virtual table to a replica if the replica's epoch is
+/// behind the virtual table epoch.  Threads calling member functions
+/// through the replica see each entry change atomically, as they do
+/// when a member function is overridden.  If multiple threads refresh
+/// the same replica concurrently, one thread performs the copy and the
+/// others wait for it to complete.  If the virtual table changes while
+/// it is being copied, the replica remains behind and is copied again
+/// the next time it is refreshed.
+/// \param [in,out] replica The virtual table replica to refresh.
+void dynamic_derived_class_base::refresh_replica(vtable_replica &replica)
+{
+	feature_state &state = *features();
+	if (replica.epoch.load(std::memory_order_acquire) == state.vtable_epoch.load(std::memory_order_acquire))
+		return;
+	while (replica.busy.exchange(true, std::memory_order_acquire))
+		std::this_thread::yield();
+	std::uint64_t const epoch = state.vtable_epoch.load(std::memory_order_acquire);
+	if (replica.epoch.load(std::memory_order_relaxed) != epoch)
+	{
+		std::copy_n(m_vtable, replica_size(), replica.vtable);
+		replica.epoch.store(epoch, std::memory_order_release);
+	}
+	replica.busy.store(false, std::memory_order_release);
+}
+
+
+/// \brief Replace member function in virtual table
+///
+/// Does the actual work involved in replacing a virtual table entry to
+/// override a virtual member function of the base class, avoiding
+/// duplication between overloads.
+/// \param [in] slot Internal representation of pointer to a virtual
+///   member function of the base class.  May be modified.
+/// \param [in] func A pointer to the function to use to override the
+///   base class member function reinterpreted as an unsigned integer of
+///   equivalent size.
+/// \param [in] size Size of the member function pointer type for the
+///   \p slot argument.
+/// \return An error code if the \p slot argument is
+///   not a supported virtual member function, or its virtual table
+///   index is out of range.
+std::error_code dynamic_derived_class_base::override_virtual_member_slot(
+		member_function_pointer_equiv &slot,
+		std::uintptr_t func,
+		std::size_t size)
+{
+	std::size_t index;
+	std::error_code const err = try_resolve_virtual_member_slot(slot, size, index);
+	if (err)
+		return err;
+	if ((m_first_overridable + m_virtual_count) <= index)
+		return dynamic_class_error::VIRTUAL_INDEX_OUT_OF_RANGE;
+	assert(m_first_overridable <= index);
+	override_virtual_member_entry(index, func);
+	return std::error_code();
+}
+
+
+/// \brief Override virtual member function by index
+///
+/// Replaces the virtual table entry for an overridable virtual member
+/// function, marks it as overridden, and propagates the change to
+/// layered classes.
+/// \param [in] index Virtual table index of the member function, in
+///   terms of the size of a virtual member function in the virtual
+///   table.  Must refer to an overridable member function.
+/// \param [in] func Pointer to the overriding function.
+void dynamic_derived_class_base::override_virtual_member_entry(std::size_t index, std::uintptr_t func)
+{
+	assert(m_first_overridable <= index);
+	assert((m_first_overridable + m_virtual_count) > index);
+	std::uintptr_t const previous = m_vtable[VTABLE_PREFIX_ENTRIES + (index * MEMBER_FUNCTION_SIZE)];
+	set_overridden(index - m_first_overridable, true);
+	if (MAME_ABI_CXX_VTABLE_FNDESC)
+	{
+		std::copy_n(
+				reinterpret_cast<std::uintptr_t const *>(func),
+				MEMBER_FUNCTION_SIZE,
+				&m_vtable[VTABLE_PREFIX_ENTRIES + (index * MEMBER_FUNCTION_SIZE)]);
+	}
+	else
+	{
+		m_vtable[VTABLE_PREFIX_ENTRIES + index] = func;
+	}
+	propagate_virtual_member_slot(index);
+	advance_vtable_epoch();
+	journal_change(false, 0, index, previous, m_vtable[VTABLE_PREFIX_ENTRIES + (index * MEMBER_FUNCTION_SIZE)]);
+#if MAME_DYNAMIC_CLASS_STATS
+	features()->stats.overrides.fetch_add(1, std::memory_order_relaxed);
 #endif
 }
 
+
+/// \brief Restore member function in virtual table
+///
+/// Does the actual work involved in restoring the base class
+/// implementation of a virtual member function.  Has no effect on the
+/// virtual table if the base class virtual table has not been captured
+/// yet.
+/// \param [in] slot Internal representation of pointer to a virtual
+///   member function of the base class.  May be modified.
+/// \param [in] size Size of the member function pointer type for the
+///   \p slot argument.
+/// \return An error code if the \p slot argument is
+///   not a supported virtual member function, or its virtual table
+///   index is out of range.
+std::error_code dynamic_derived_class_base::restore_virtual_member_slot(
+		member_function_pointer_equiv &slot,
+		std::size_t size)
+{
+	std::size_t index;
+	std::error_code const err = try_resolve_virtual_member_slot(slot, size, index);
+	if (err)
+		return err;
+	if ((m_first_overridable + m_virtual_count) <= index)
+		return dynamic_class_error::VIRTUAL_INDEX_OUT_OF_RANGE;
+	assert(m_first_overridable <= index);
+	auto const base_vtable = reinterpret_cast<std::uintptr_t const *>(m_base_vtable.load(std::memory_order_acquire));
+	std::uintptr_t const previous = m_vtable[VTABLE_PREFIX_ENTRIES + (index * MEMBER_FUNCTION_SIZE)];
+	if (is_overridden(index - m_first_overridable) && base_vtable)
+	{
+		std::copy_n(
+				base_vtable + (index * MEMBER_FUNCTION_SIZE),
+				MEMBER_FUNCTION_SIZE,
+				&m_vtable[VTABLE_PREFIX_ENTRIES + (index * MEMBER_FUNCTION_SIZE)]);
+	}
+	set_overridden(index - m_first_overridable, false);
+	propagate_virtual_member_slot(index);
+	advance_vtable_epoch();
+	journal_change(true, 0, index, previous, m_vtable[VTABLE_PREFIX_ENTRIES + (index * MEMBER_FUNCTION_SIZE)]);
+#if MAME_DYNAMIC_CLASS_STATS
+	features()->stats.restores.fetch_add(1, std::memory_order_relaxed);
+#endif
+	return std::error_code();
+}
+
+
+/// \brief Replace member function in secondary virtual table
+///
+/// Does the actual work involved in replacing a secondary virtual table
+/// entry to override a virtual member function of a secondary base
+/// class, avoiding duplication between overloads.
+/// \param [in] offset Offset to the secondary base class within the
+///   base class in bytes.
+/// \param [in] slot Internal representation of pointer to a virtual
+///   member function of the secondary base class.  May be modified.
+/// \param [in] func A pointer to the thunk to use to override the
+///   member function reinterpreted as an unsigned integer of equivalent
+///   size.
+/// \param [in] size Size of the member function pointer type for the
+///   \p slot argument.
+/// \return An error code if the secondary base class
+///   has not been added, or the \p slot argument is not a supported
+///   virtual member function or its virtual table index is out of
+///   range.
+std::error_code dynamic_derived_class_base::override_secondary_member_slot(
+		std::ptrdiff_t offset,
+		member_function_pointer_equiv &slot,
+		std::uintptr_t func,
+		std::size_t size)
+{
+	auto const secondary = const_cast<secondary_vtable *>(find_secondary_vtable(offset));
+	if (!secondary)
+		return dynamic_class_error::SECONDARY_BASE_NOT_ADDED;
+	std::size_t index;
+	std::error_code const err = try_resolve_virtual_member_slot(slot, size, index);
+	if (err)
+		return err;
+	if ((secondary->first_overridable + secondary->virtual_count) <= index)
+		return dynamic_class_error::VIRTUAL_INDEX_OUT_OF_RANGE;
+	assert(secondary->first_overridable <= index);
+	std::uintptr_t *const overridden = &secondary->vtable[VTABLE_PREFIX_ENTRIES + ((secondary->first_overridable + secondary->virtual_count) * MEMBER_FUNCTION_SIZE)];
+	std::size_t const flag = index - secondary->first_overridable;
+	std::uintptr_t const previous = secondary->vtable[VTABLE_PREFIX_ENTRIES + (index * MEMBER_FUNCTION_SIZE)];
+	overridden[flag / OVERRIDDEN_FLAGS_PER_ENTRY] |= std::uintptr_t(1) << (flag % OVERRIDDEN_FLAGS_PER_ENTRY);
+	if (MAME_ABI_CXX_VTABLE_FNDESC)
+	{
+		std::copy_n(
+				reinterpret_cast<std::uintptr_t const *>(func),
+				MEMBER_FUNCTION_SIZE,
+				&secondary->vtable[VTABLE_PREFIX_ENTRIES + (index * MEMBER_FUNCTION_SIZE)]);
+	}
+	else
+	{
+		secondary->vtable[VTABLE_PREFIX_ENTRIES + index] = func;
+	}
+	journal_change(false, offset, index, previous, secondary->vtable[VTABLE_PREFIX_ENTRIES + (index * MEMBER_FUNCTION_SIZE)]);
+#if MAME_DYNAMIC_CLASS_STATS
+	features()->stats.overrides.fetch_add(1, std::memory_order_relaxed);
+#endif
+	return std::error_code();
+}
+
+
+/// \brief Restore member function in secondary virtual table
+///
+/// Does the actual work involved in restoring the base class
+/// implementation of a virtual member function of a secondary base
+/// class.  Has no effect on the virtual table if the base class virtual
+/// table has not been captured yet.
+/// \param [in] offset Offset to the secondary base class within the
+///   base class in bytes.
+/// \param [in] slot Internal representation of pointer to a virtual
+///   member function of the secondary base class.  May be modified.
+/// \param [in] size Size of the member function pointer type for the
+///   \p slot argument.
+/// \return An error code if the secondary base class
+///   has not been added, or the \p slot argument is not a supported
+///   virtual member function or its virtual table index is out of
+///   range.
+std::error_code dynamic_derived_class_base::restore_secondary_member_slot(
+		std::ptrdiff_t offset,
+		member_function_pointer_equiv &slot,
+		std::size_t size)
+{
+	auto const secondary = const_cast<secondary_vtable *>(find_secondary_vtable(offset));
+	if (!secondary)
+		return dynamic_class_error::SECONDARY_BASE_NOT_ADDED;
+	std::size_t index;
+	std::error_code const err = try_resolve_virtual_member_slot(slot, size, index);
+	if (err)
+		return err;
+	if ((secondary->first_overridable + secondary->virtual_count) <= index)
+		return dynamic_class_error::VIRTUAL_INDEX_OUT_OF_RANGE;
+	assert(secondary->first_overridable <= index);
+	std::uintptr_t *const overridden = &secondary->vtable[VTABLE_PREFIX_ENTRIES + ((secondary->first_overridable + secondary->virtual_count) * MEMBER_FUNCTION_SIZE)];
+	std::size_t const flag = index - secondary->first_overridable;
+	std::uintptr_t const previous = secondary->vtable[VTABLE_PREFIX_ENTRIES + (index * MEMBER_FUNCTION_SIZE)];
+	if (secondary->base_vtable)
+	{
+		std::copy_n(
+				secondary->base_vtable + (index * MEMBER_FUNCTION_SIZE),
+				MEMBER_FUNCTION_SIZE,
+				&secondary->vtable[VTABLE_PREFIX_ENTRIES + (index * MEMBER_FUNCTION_SIZE)]);
+	}
+	overridden[flag / OVERRIDDEN_FLAGS_PER_ENTRY] &= ~(std::uintptr_t(1) << (flag % OVERRIDDEN_FLAGS_PER_ENTRY));
+	journal_change(true, offset, index, previous, secondary->vtable[VTABLE_PREFIX_ENTRIES + (index * MEMBER_FUNCTION_SIZE)]);
+#if MAME_DYNAMIC_CLASS_STATS
+	features()->stats.restores.fetch_add(1, std::memory_order_relaxed);
+#endif
+	return std::error_code();
+}
+
+
+/// \brief Save overridable member function entries and flags
+///
+/// Copies the virtual table entries for all overridable member
+/// functions followed by the overridden member function flags.
+/// \param [out] dest Destination for the number of entries returned by
+///   \c profile_size.
+void dynamic_derived_class_base::save_profile(std::uintptr_t *dest) const
+{
+	std::copy_n(&m_vtable[VTABLE_PREFIX_ENTRIES + (m_first_overridable * MEMBER_FUNCTION_SIZE)], profile_size(), dest);
+}
+
+
+/// \brief Restore overridable member function entries and flags
+///
+/// Replaces the overridden member function flags, and the virtual table
+/// entries for member functions that were overridden when the entries
+/// were saved.  Entries for member functions that were not overridden
+/// are copied from the current base class virtual table, or the parent
+/// class virtual table for a layered class, so changes made to it since
+/// the entries were saved are not lost.  Each entry that changes is
+/// recorded in the journal and counted as an override or restoration.
+/// \param [in] src Entries previously saved using \c save_profile.
+void dynamic_derived_class_base::apply_profile(std::uintptr_t const *src)
+{
+	std::size_t const entries = m_virtual_count * MEMBER_FUNCTION_SIZE;
+	std::copy_n(src + entries, profile_size() - entries, m_overridden);
+	auto const current = reinterpret_cast<std::uintptr_t const *>(m_base_vtable.load(std::memory_order_acquire));
+	feature_state *const state = features();
+	for (std::size_t i = 0; m_virtual_count > i; ++i)
+	{
+		std::size_t const offset = (i + m_first_overridable) * MEMBER_FUNCTION_SIZE;
+		bool const overridden = is_overridden(i);
+		std::uintptr_t const *const source = (overridden || !current) ? (src + (i * MEMBER_FUNCTION_SIZE)) : (current + offset);
+		std::uintptr_t *const dest = &m_vtable[VTABLE_PREFIX_ENTRIES + offset];
+		if (!std::equal(source, source + MEMBER_FUNCTION_SIZE, dest))
+		{
+			std::uintptr_t const previous = *dest;
+			std::copy_n(source, MEMBER_FUNCTION_SIZE, dest);
+			journal_change(!overridden, 0, i + m_first_overridable, previous, *dest);
+#if MAME_DYNAMIC_CLASS_STATS
+			(overridden ? state->stats.overrides : state->stats.restores).fetch_add(1, std::memory_order_relaxed);
+#endif
+		}
+	}
+	if (state && !state->children.empty())
+	{
+		for (std::size_t i = 0; m_virtual_count > i; ++i)
+			propagate_virtual_member_slot(i + m_first_overridable);
+	}
+	advance_vtable_epoch();
+}
+
+
+/// \brief Propagate member function to layered classes
+///
+/// Copies the virtual table entry for a member function to layered
+/// classes using this class as their parent that have not overridden
+/// the member function, recursively.
+/// \param [in] index The virtual table index of the member function, in
+///   terms of the size of a virtual member function in the virtual
+///   table.
+void dynamic_derived_class_base::propagate_virtual_member_slot(std::size_t index)
+{
+	feature_state const *const state = features();
+	if (!state)
+		return;
+	for (dynamic_derived_class_base *const child : state->children)
+	{
+		if (!child->is_overridden(index - m_first_overridable))
+		{
+			std::copy_n(
+					&m_vtable[VTABLE_PREFIX_ENTRIES + (index * MEMBER_FUNCTION_SIZE)],
+					MEMBER_FUNCTION_SIZE,
+					&child->m_vtable[VTABLE_PREFIX_ENTRIES + (index * MEMBER_FUNCTION_SIZE)]);
+			child->propagate_virtual_member_slot(index);
+			child->advance_vtable_epoch();
+		}
+	}
+}
+
 } // namespace detail
 
+
+
+//**************************************************************************
+//  dynamic_derived_class_profile
+//**************************************************************************
+
+/// \brief Create empty profile
+///
+/// Creates a profile with no saved classes.
+/// \param [in] name A name for the profile.  This is not interpreted
+///   and need not be unique.
+dynamic_derived_class_profile::dynamic_derived_class_profile(std::string_view name) :
+	m_name(name)
+{
+}
+
+
+/// \brief Apply saved state for all classes
+///
+/// Restores the overridable member function entries and overridden
+/// flags of all classes saved in the profile.
+void dynamic_derived_class_profile::apply() const
+{
+	for (entry const &e : m_entries)
+		e.cls->apply_profile(&m_data[e.offset]);
+}
+
+
+/// \brief Remove all classes from profile
+///
+/// Discards the saved state for all classes.
+void dynamic_derived_class_profile::clear()
+{
+	m_entries.clear();
+	m_data.clear();
+}
+
+
+/// \brief Find saved class state
+///
+/// Finds the saved state for the specified class.
+/// \param [in] cls The dynamic derived class to look for.
+/// \return An iterator referring to the saved state for the class, or
+///   the end iterator if the class has not been saved in the profile.
+std::vector<dynamic_derived_class_profile::entry>::const_iterator dynamic_derived_class_profile::find(
+		detail::dynamic_derived_class_base const &cls) const
+{
+	return std::find_if(
+			m_entries.begin(),
+			m_entries.end(),
+			[&cls] (entry const &e) { return e.cls == &cls; });
+}
+
+
+/// \brief Save class state
+///
+/// Does the actual work of saving the state of a class, avoiding
+/// template instantiations for each class type.
+/// \param [in] cls The dynamic derived class to save.
+void dynamic_derived_class_profile::save(detail::dynamic_derived_class_base &cls)
+{
+	auto const existing = find(cls);
+	std::size_t offset;
+	if (m_entries.end() != existing)
+	{
+		offset = existing->offset;
+	}
+	else
+	{
+		offset = m_data.size();
+		m_data.resize(offset + cls.profile_size());
+		m_entries.emplace_back(entry{ &cls, offset });
+	}
+	cls.save_profile(&m_data[offset]);
+}
+
+
+/// \brief Apply saved class state
+///
+/// Does the actual work of restoring the state of a class, avoiding
+/// template instantiations for each class type.
+/// \param [in] cls The dynamic derived class to restore.
+/// \exception std::invalid_argument Thrown if the class has not been
+///   saved in the profile.
+void dynamic_derived_class_profile::apply(detail::dynamic_derived_class_base &cls) const
+{
+	auto const existing = find(cls);
+	if (m_entries.end() == existing)
+		detail::dynamic_derived_class_base::throw_error(dynamic_class_error::NOT_IN_PROFILE);
+	cls.apply_profile(&m_data[existing->offset]);
+}
+
+
+/// \brief Remove class from profile
+///
+/// Does the actual work of discarding the saved state of a class,
+/// avoiding template instantiations for each class type.
+/// \param [in] cls The dynamic derived class to remove.
+void dynamic_derived_class_profile::remove(detail::dynamic_derived_class_base const &cls)
+{
+	auto const existing = find(cls);
+	if (m_entries.end() != existing)
+	{
+		std::size_t const offset = existing->offset;
+		std::size_t const size = cls.profile_size();
+		m_data.erase(m_data.begin() + offset, m_data.begin() + offset + size);
+		m_entries.erase(existing);
+		for (entry &e : m_entries)
+		{
+			if (e.offset > offset)
+				e.offset -= size;
+		}
+	}
+}
+
+
+
+//**************************************************************************
+//  dynamic_derived_class_journal
+//**************************************************************************
+
+std::atomic<dynamic_derived_class_journal *> dynamic_derived_class_journal::s_installed(nullptr);
+
+
+/// \brief Create journal
+///
+/// Creates an empty journal.  The journal does not record events until
+/// it is installed.
+/// \param [in] capacity Maximum number of events to retain.  Rounded up
+///   to a power of two.
+/// \exception std::bad_alloc Thrown if allocating memory for the ring
+///   buffer fails.
+dynamic_derived_class_journal::dynamic_derived_class_journal(std::size_t capacity) :
+	m_mask(0),
+	m_head(0)
+{
+	while (capacity > (m_mask + 1))
+		m_mask = (m_mask << 1) | 1;
+	m_entries = std::make_unique<entry []>(m_mask + 1);
+}
+
+
+dynamic_derived_class_journal::~dynamic_derived_class_journal()
+{
+	assert(installed() != this);
+}
+
+
+/// \brief Install journal
+///
+/// Makes a journal the destination for recorded events, replacing the
+/// journal that was previously installed.
+/// \param [in] journal The journal to install, or \c nullptr to stop
+///   recording events.
+/// \return The journal that was previously installed, or \c nullptr if
+///   no journal was installed.
+dynamic_derived_class_journal *dynamic_derived_class_journal::install(dynamic_derived_class_journal *journal)
+{
+	return s_installed.exchange(journal, std::memory_order_acq_rel);
+}
+
+
+/// \brief Record event
+///
+/// Adds an event to the ring buffer, overwriting the oldest event if
+/// the buffer is full.  Lock-free and does not allocate memory.
+/// \param [in] e The event to record.
+void dynamic_derived_class_journal::record(event const &e) noexcept
+{
+	std::uint64_t const position = m_head.fetch_add(1, std::memory_order_relaxed);
+	entry &slot = m_entries[position & m_mask];
+	slot.sequence.store((position << 1) | 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	std::uint64_t name[sizeof(e.class_name) / sizeof(std::uint64_t)];
+	std::memcpy(name, e.class_name, sizeof(name));
+	slot.words[0].store(e.timestamp, std::memory_order_relaxed);
+	slot.words[1].store(e.thread, std::memory_order_relaxed);
+	slot.words[2].store(e.restore ? 1 : 0, std::memory_order_relaxed);
+	slot.words[3].store(std::uint64_t(e.offset), std::memory_order_relaxed);
+	slot.words[4].store(e.slot, std::memory_order_relaxed);
+	slot.words[5].store(e.previous, std::memory_order_relaxed);
+	slot.words[6].store(e.current, std::memory_order_relaxed);
+	for (std::size_t i = 0; std::size(name) > i; ++i)
+		slot.words[7 + i].store(name[i], std::memory_order_relaxed);
+
+	slot.sequence.store((position + 1) << 1, std::memory_order_release);
+}
+
+
+/// \brief Get recorded events
+///
+/// Copies the events currently retained in the ring buffer, from
+/// oldest to newest.
+/// \return The retained events.
+/// \exception std::bad_alloc Thrown if allocating memory for the
+///   result fails.
+std::vector<dynamic_derived_class_journal::event> dynamic_derived_class_journal::snapshot() const
+{
+	std::uint64_t const head = m_head.load(std::memory_order_acquire);
+	std::uint64_t const start = (head > capacity()) ? (head - capacity()) : 0;
+	std::vector<event> result;
+	result.reserve(head - start);
+	event e;
+	for (std::uint64_t position = start; head > position; ++position)
+	{
+		if (read(position, e))
+			result.emplace_back(e);
+	}
+	return result;
+}
+
+
+/// \brief Dump recorded events as text
+///
+/// Formats the events currently retained in the ring buffer as text,
+/// one line per event from oldest to newest, and passes each line to
+/// the supplied output function.  Does not allocate memory or take
+/// locks, so it may be used from a signal handler if the output
+/// function is safe to use in the same context.
+/// \param [in] output Function to call with each line of text.
+/// \param [in] param Parameter to pass to the output function.
+void dynamic_derived_class_journal::dump(sink output, void *param) const noexcept
+{
+	std::uint64_t const head = m_head.load(std::memory_order_acquire);
+	std::uint64_t const start = (head > capacity()) ? (head - capacity()) : 0;
+	event e;
+	for (std::uint64_t position = start; head > position; ++position)
+	{
+		if (read(position, e))
+		{
+			char line[192];
+			std::size_t length = 0;
+			append_number(line, length, sizeof(line), e.timestamp, 10);
+			append_text(line, length, sizeof(line), " thread ");
+			append_number(line, length, sizeof(line), e.thread, 10);
+			append_text(line, length, sizeof(line), " ");
+			append_text(line, length, sizeof(line), e.class_name);
+			append_text(line, length, sizeof(line), e.restore ? " restore slot " : " override slot ");
+			append_number(line, length, sizeof(line), e.slot, 10);
+			if (e.offset)
+			{
+				append_text(line, length, sizeof(line), " offset ");
+				append_number(line, length, sizeof(line), e.offset, 10);
+			}
+			append_text(line, length, sizeof(line), " 0x");
+			append_number(line, length, sizeof(line), e.previous, 16);
+			append_text(line, length, sizeof(line), " -> 0x");
+			append_number(line, length, sizeof(line), e.current, 16);
+			append_text(line, length, sizeof(line), "\n");
+			output(param, line, length);
+		}
+	}
+}
+
+
+/// \brief Read event from ring buffer
+///
+/// Decodes an event from the ring buffer if it is complete and has not
+/// been overwritten.
+/// \param [in] position Event number to read.
+/// \param [out] e Receives the decoded event.
+/// \return True if the event was read, or false if it is incomplete or
+///   has been overwritten.
+bool dynamic_derived_class_journal::read(std::uint64_t position, event &e) const noexcept
+{
+	entry const &slot = m_entries[position & m_mask];
+	std::uint64_t const expected = (position + 1) << 1;
+	if (slot.sequence.load(std::memory_order_acquire) != expected)
+		return false;
+
+	std::uint64_t name[sizeof(e.class_name) / sizeof(std::uint64_t)];
+	e.timestamp = slot.words[0].load(std::memory_order_relaxed);
+	e.thread = slot.words[1].load(std::memory_order_relaxed);
+	e.restore = slot.words[2].load(std::memory_order_relaxed);
+	e.offset = std::ptrdiff_t(slot.words[3].load(std::memory_order_relaxed));
+	e.slot = slot.words[4].load(std::memory_order_relaxed);
+	e.previous = slot.words[5].load(std::memory_order_relaxed);
+	e.current = slot.words[6].load(std::memory_order_relaxed);
+	for (std::size_t i = 0; std::size(name) > i; ++i)
+		name[i] = slot.words[7 + i].load(std::memory_order_relaxed);
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (slot.sequence.load(std::memory_order_relaxed) != expected)
+		return false;
+	std::memcpy(e.class_name, name, sizeof(name));
+	return true;
+}
+
+
+
+//**************************************************************************
+//  virtual table replicas
+//**************************************************************************
+
+/// \brief Get number of replica groups
+///
+/// Gets the number of NUMA nodes in the system, suitable for passing to
+/// \c set_replica_count to use one virtual table replica per node.  On
+/// Linux this is determined from the online nodes listed in sysfs.  On
+/// other systems, or if the nodes cannot be determined, a single node
+/// is assumed, so virtual table replicas are not used.
+/// \return The number of replica groups.
+std::size_t dynamic_replica_group_count()
+{
+	static std::size_t const count =
+			[] () -> std::size_t
+			{
+				std::size_t result = 1;
+#if defined(__linux__)
+				std::FILE *const file = std::fopen("/sys/devices/system/node/online", "r");
+				if (file)
+				{
+					// list of ranges, e.g. "0-3" or "0,2-3"
+					unsigned long first, last;
+					while (1 == std::fscanf(file, "%lu", &first))
+					{
+						last = first;
+						int separator = std::fgetc(file);
+						if (('-' == separator) && (1 == std::fscanf(file, "%lu", &last)))
+							separator = std::fgetc(file);
+						result = (std::max)(result, std::size_t(last + 1));
+						if (',' != separator)
+							break;
+					}
+					std::fclose(file);
+				}
+#endif
+				return result;
+			}();
+	return count;
+}
+
+
+/// \brief Get replica group for calling thread
+///
+/// Gets the virtual table replica group for the calling thread.  If no
+/// group has been selected, it is detected from the NUMA node the
+/// thread is running on the first time this is called.  The detected
+/// group is not updated if the thread later migrates to a different
+/// node, so threads should be bound to a node or select their group
+/// explicitly.
+/// \return The replica group for the calling thread.
+std::size_t current_dynamic_replica_group()
+{
+	std::size_t &group = thread_replica_group();
+	if (dynamic_replica_group_auto == group)
+		group = current_numa_node();
+	return group;
+}
+
+
+/// \brief Select replica group for calling thread
+///
+/// Selects the virtual table replica group for the calling thread.
+/// This allows threads to be grouped explicitly, for example to match
+/// a thread pool's affinity, or to use replicas on a system with a
+/// single NUMA node.
+/// \param [in] group The replica group, or
+///   \c dynamic_replica_group_auto to detect it from the NUMA node the
+///   thread is running on.
+void set_dynamic_replica_group(std::size_t group)
+{
+	thread_replica_group() = group;
+}
+
+
+
+//**************************************************************************
+//  statistics
+//**************************************************************************
+
+/// \brief Get aggregate statistics
+///
+/// Gets statistics aggregated across all dynamic derived classes,
+/// including counters from classes that have been destroyed.  All
+/// fields are zero unless \c MAME_DYNAMIC_CLASS_STATS is non-zero.
+/// The peak number of live instances is tracked across all classes
+/// rather than summed.  The result is approximate if classes or
+/// instances are being created or destroyed concurrently.
+/// \return Statistics for all dynamic derived classes.
+dynamic_derived_class_stats dynamic_derived_class_aggregate_stats()
+{
+	dynamic_derived_class_stats result;
+#if MAME_DYNAMIC_CLASS_STATS
+	stats_registry &registry = get_stats_registry();
+	std::lock_guard<std::mutex> guard(registry.mutex);
+	result = registry.retired;
+	for (detail::dynamic_derived_class_base const *cls : registry.classes)
+		cls->collect_stats(result);
+	result.classes = registry.classes.size();
+	result.classes_created = registry.classes_created;
+	result.live_instances = detail::dynamic_derived_class_base::s_total_stats.live_instances.load(std::memory_order_relaxed);
+	result.peak_instances = detail::dynamic_derived_class_base::s_total_stats.peak_instances.load(std::memory_order_relaxed);
+	result.resolve_calls = registry.resolve_calls.load(std::memory_order_relaxed);
+	result.resolve_nanoseconds = registry.resolve_nanoseconds.load(std::memory_order_relaxed);
+#endif
+	return result;
+}
+
 } // namespace util
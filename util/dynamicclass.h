@@ -44,21 +44,245 @@
 
 #include <algorithm>
 #include <array>
-#include <bitset>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
 #include <string>
 #include <string_view>
+#include <system_error>
 #include <tuple>
 #include <type_traits>
 #include <typeinfo>
 #include <utility>
+#include <vector>
+
+
+/// \brief Enable dynamic derived class statistics
+///
+/// Define to a non-zero value to maintain counters for dynamic derived
+/// classes and time spent resolving virtual member functions.  When
+/// zero, the code updating the counters is not compiled and statistics
+/// report memory usage only.  The counters are always declared, so the
+/// layout of dynamic derived classes does not depend on this setting.
+/// It should still be the same for every translation unit in a
+/// program.  Otherwise, only events in translation units compiled with
+/// counters enabled are counted.
+#ifndef MAME_DYNAMIC_CLASS_STATS
+#define MAME_DYNAMIC_CLASS_STATS 0
+#endif
+
+/// \brief Report dynamic derived class errors using exceptions
+///
+/// When non-zero, errors are reported by throwing
+/// \c std::invalid_argument or \c std::runtime_error.  When zero,
+/// errors reported by functions that do not return error codes
+/// terminate the program.  Defaults to non-zero if exceptions are
+/// enabled.
+#ifndef MAME_DYNAMIC_CLASS_EXCEPTIONS
+#if defined(__cpp_exceptions) || defined(_CPPUNWIND)
+#define MAME_DYNAMIC_CLASS_EXCEPTIONS 1
+#else
+#define MAME_DYNAMIC_CLASS_EXCEPTIONS 0
+#endif
+#endif
 
 
 namespace util {
 
+class dynamic_derived_class_journal;
+class dynamic_derived_class_profile;
+struct dynamic_derived_class_stats;
+class dynamic_override_cache;
+
+dynamic_derived_class_stats dynamic_derived_class_aggregate_stats();
+std::size_t dynamic_replica_group_count();
+std::size_t current_dynamic_replica_group();
+void set_dynamic_replica_group(std::size_t group);
+
+/// \brief Virtual member function count supplied at run time
+///
+/// Use as the virtual member function count for a dynamic derived class
+/// to supply the count when constructing the dynamic derived class.
+/// The virtual table is allocated dynamically rather than stored in
+/// the dynamic derived class object.
+inline constexpr std::size_t dynamic_virtual_count = ~std::size_t(0);
+
+/// \brief Select virtual table replica group automatically
+///
+/// Use as the group for \c set_dynamic_replica_group to select the
+/// virtual table replica group for the calling thread from the NUMA
+/// node it is running on.  This is the default for all threads.
+inline constexpr std::size_t dynamic_replica_group_auto = ~std::size_t(0);
+
+/// \brief Aligned instance layout
+///
+/// Use as the extra data type for a dynamic derived class to align
+/// instances to the specified boundary, typically the size of a cache
+/// line.  The base class is placed at the start of each instance,
+/// followed by the extra data.  The extra data is accessed as the
+/// member \c extra of the value type as usual.
+/// \tparam Extra Extra data type, or \c void if not required.
+/// \tparam Alignment Required alignment for instances in bytes.  Must
+///   be a power of two.
+template <typename Extra, std::size_t Alignment = 64>
+struct dynamic_derived_class_aligned;
+
+/// \brief Instance layout with extra data preceding base class
+///
+/// Use as the extra data type for a dynamic derived class to place the
+/// extra data immediately before the base class in each instance.  This
+/// allows extra data used by overriding member functions to share a
+/// cache line with the virtual table pointer and the first members of
+/// a large base class.  The address of the base class is still used as
+/// the address of the instance.  The extra data is accessed using the
+/// member function \c extra of the value type rather than a data
+/// member.  Storage for the extra data and base class is aligned to the
+/// specified boundary.
+/// \tparam Extra Extra data type.
+/// \tparam Alignment Required alignment for the storage in bytes.  Must
+///   be a power of two.
+template <typename Extra, std::size_t Alignment = 64>
+struct dynamic_derived_class_prefix;
+
+/// \brief Tracked instance layout
+///
+/// Use as the extra data type for a dynamic derived class to keep a
+/// list of live instances of the class.  Each instance holds an
+/// intrusive link, which is added to the list when the instance is
+/// created and removed when it is destroyed.  This allows enumerating
+/// instances and moving them to another class.  The extra data is
+/// accessed as the member \c extra of the value type as usual.
+///
+/// The list is protected by a mutex owned by the class, which is locked
+/// each time an instance is created or destroyed.  Threads creating or
+/// destroying instances of the same tracked class concurrently are
+/// serialised on the mutex and contend for its cache line, so this
+/// layout is not suitable for classes with high instance churn across
+/// many threads.  Instances of different classes use different mutexes.
+/// \tparam Extra Extra data type, or \c void if not required.  May not
+///   be an alternate instance layout.
+template <typename Extra>
+struct dynamic_derived_class_tracked;
+
+/// \brief Column instance layout
+///
+/// Use as the extra data type for a dynamic derived class to store
+/// extra data in structure-of-arrays columns owned by the class rather
+/// than in each instance.  Each instance holds a compact row index, and
+/// its extra data is accessed using the member function template
+/// \c column of the value type.  This allows batch operations over the
+/// extra data of all instances to run over contiguous arrays.  Rows are
+/// reused by moving the last row when an instance is destroyed, so the
+/// row index of an instance may change.
+/// \tparam T Column element types.  Must be nothrow default
+///   constructible and nothrow move assignable.  Use an integer type
+///   rather than \c bool for flags.
+template <typename... T>
+struct dynamic_derived_class_columns;
+
+/// \brief Instance reference counting mode
+///
+/// Selects how a dynamic derived class counts references held by its
+/// instances.  Reference counting allows a dynamic derived class to be
+/// reclaimed automatically when its last instance is destroyed.
+enum class dynamic_reference_mode
+{
+	NONE,           ///< Instances do not hold references
+	SINGLE_THREAD,  ///< Non-atomic count, for classes only used by one thread
+	SHARDED         ///< Atomic counts spread across cache lines
+};
+
+/// \brief Dynamic derived class error conditions
+///
+/// Errors reported by dynamic derived class operations.  Functions with
+/// names beginning with \c try_ return these as \c std::error_code
+/// values in the category returned by \c dynamic_class_category rather
+/// than throwing exceptions.
+enum class dynamic_class_error
+{
+	INVALID_CLASS_NAME = 1,         ///< Class name is invalid or unsupported
+	NOT_VIRTUAL,                    ///< Not a pointer to a virtual member function
+	UNSUPPORTED_MEMBER_FUNCTION,    ///< Unsupported pointer to a virtual member function
+	THIS_POINTER_ADJUSTMENT,        ///< Member function requires this pointer adjustment
+	INVALID_VIRTUAL_INDEX,          ///< Invalid virtual table index
+	VIRTUAL_INDEX_OUT_OF_RANGE,     ///< Virtual table index out of range
+	UNSUPPORTED_ARCHITECTURE,       ///< Target architecture not supported
+	VIRTUAL_COUNT_MISMATCH,         ///< Virtual member function count does not match template argument
+	INVALID_EXEMPLAR,               ///< Exemplar is not an instance of the base class
+	SECONDARY_BASE_NOT_ADDED,       ///< Secondary base class has not been added
+	INVALID_SECONDARY_BASE,         ///< Secondary base class shares primary virtual table or already added
+	LAYERED_SECONDARY_BASE,         ///< Layered class with secondary virtual tables
+	BASE_VTABLE_CAPTURED,           ///< Base class virtual table already captured
+	SECONDARY_BASE_MISMATCH,        ///< Target class has different secondary base classes
+	REFERENCE_COUNTING_DISABLED,    ///< Reference counting is not enabled
+	NOT_IN_PROFILE,                 ///< Class has not been saved in profile
+	MODULE_NOT_LOADED,              ///< Override module could not be loaded
+	SYMBOL_NOT_FOUND,               ///< Override function not found in module
+	INVALID_CACHE,                  ///< Override cache file is invalid
+	NOT_IN_CACHE,                   ///< Class has not been saved in override cache
+	UNNAMED_OVERRIDE,               ///< Overriding function has no exported symbol name
+	SECONDARY_OVERRIDE,             ///< Secondary base class member function overridden
+	REPLICAS_IN_USE                 ///< Virtual table replicas used by instances
+};
+
+std::error_category const &dynamic_class_category() noexcept;
+
+/// \brief Make error code for dynamic derived class error
+///
+/// Allows \c dynamic_class_error values to be used where a
+/// \c std::error_code is expected.
+/// \param [in] err The error condition.
+/// \return An error code in the dynamic derived class category.
+inline std::error_code make_error_code(dynamic_class_error err) noexcept
+{
+	return std::error_code(int(err), dynamic_class_category());
+}
+
+} // namespace util
+
+
+namespace std {
+
+template <> struct is_error_code_enum<util::dynamic_class_error> : public std::true_type { };
+
+} // namespace std
+
+
+namespace util {
+
+/// \brief Dynamic derived class statistics
+///
+/// Statistics for a single dynamic derived class, or aggregated across
+/// all dynamic derived classes.  Counters are only maintained if
+/// \c MAME_DYNAMIC_CLASS_STATS is non-zero, otherwise they are always
+/// zero.  Memory usage is always reported for a single class, and for
+/// the aggregate if counters are maintained.  Counters for classes
+/// that have been destroyed are included in the aggregate.
+struct dynamic_derived_class_stats
+{
+	std::size_t classes = 0;                ///< Live classes (aggregate only)
+	std::size_t classes_created = 0;        ///< Classes created (aggregate only)
+	std::size_t classes_destroyed = 0;      ///< Classes destroyed (aggregate only)
+	std::size_t live_instances = 0;         ///< Instances not yet destroyed
+	std::size_t peak_instances = 0;         ///< Maximum number of live instances
+	std::size_t instances_created = 0;      ///< Instances created
+	std::size_t instances_destroyed = 0;    ///< Instances destroyed
+	std::size_t overrides = 0;              ///< Member functions overridden
+	std::size_t restores = 0;               ///< Base member functions restored
+	std::size_t vtable_bytes = 0;           ///< Memory used by virtual tables and flags
+	std::size_t name_bytes = 0;             ///< Memory used by class names
+	std::size_t type_info_bytes = 0;        ///< Memory used by type info
+	std::size_t resolve_calls = 0;          ///< Virtual member functions resolved (aggregate only)
+	std::uint64_t resolve_nanoseconds = 0;  ///< Time spent resolving virtual member functions (aggregate only)
+};
+
+
 namespace detail {
 
 /// \brief Dynamic derived class base
@@ -91,6 +315,12 @@ protected:
 	/// table for a virtual destructor.
 	static constexpr std::size_t VTABLE_DESTRUCTOR_ENTRIES = (MAME_ABI_CXX_TYPE == MAME_ABI_CXX_MSVC) ? 1 : 2;
 
+	/// \brief Number of overridden flags per storage entry
+	///
+	/// The number of overridden member function flags packed into each
+	/// pointer-sized storage entry following the virtual table.
+	static constexpr std::size_t OVERRIDDEN_FLAGS_PER_ENTRY = sizeof(std::uintptr_t) * 8;
+
 	/// \brief Virtual table index for base virtual table recovery
 	///
 	/// Index of the virtual table entry used for recovering the base
@@ -197,6 +427,161 @@ protected:
 	template <typename T>
 	using member_function_pointer_pun_t = typename member_function_pointer_pun<T>::type;
 
+	/// \brief Intrusive instance list link
+	///
+	/// Links an instance into the list of instances of the dynamic
+	/// derived class that owns it.  Only present for the tracked
+	/// instance layout.
+	struct instance_link
+	{
+		instance_link *prev = nullptr;                          ///< Previous link in list
+		instance_link *next = nullptr;                          ///< Next link in list
+		std::atomic<dynamic_derived_class_base *> owner = nullptr; ///< Dynamic derived class owning the instance
+	};
+
+	template <typename T>
+	struct is_layout_wrapper : std::false_type { };
+
+	template <typename Extra, std::size_t Alignment>
+	struct is_layout_wrapper<dynamic_derived_class_aligned<Extra, Alignment> > : std::true_type { };
+
+	template <typename Extra, std::size_t Alignment>
+	struct is_layout_wrapper<dynamic_derived_class_prefix<Extra, Alignment> > : std::true_type { };
+
+	template <typename Extra>
+	struct is_layout_wrapper<dynamic_derived_class_tracked<Extra> > : std::true_type { };
+
+	template <typename... T>
+	struct is_layout_wrapper<dynamic_derived_class_columns<T...> > : std::true_type { };
+
+	template <typename T>
+	struct is_tracked : std::false_type { };
+
+	template <typename Extra>
+	struct is_tracked<dynamic_derived_class_tracked<Extra> > : std::true_type { };
+
+	/// \brief Extra data columns base
+	///
+	/// Allows extra data columns to be owned and destroyed without
+	/// knowing the column element types.
+	class column_storage_base
+	{
+	public:
+		virtual ~column_storage_base() = default;
+	};
+
+	/// \brief Extra data columns
+	///
+	/// Holds the extra data for instances of a dynamic derived class
+	/// using the column instance layout, along with a pointer to the row
+	/// index of the instance that owns each row.  Not thread-safe.
+	/// \tparam T Column element types.
+	template <typename... T>
+	class column_storage : public column_storage_base
+	{
+	public:
+		static_assert(sizeof...(T), "At least one column is required");
+		static_assert(std::conjunction_v<std::is_nothrow_default_constructible<T>...>, "Column types must be nothrow default constructible");
+		static_assert(std::conjunction_v<std::is_nothrow_move_assignable<T>...>, "Column types must be nothrow move assignable");
+		static_assert(!std::disjunction_v<std::is_same<T, bool>...>, "Use an integer type rather than bool for columns");
+
+		/// \brief Get number of rows
+		///
+		/// \return The number of rows, equal to the number of live
+		///   instances.
+		std::size_t size() const { return m_rows.size(); }
+
+		/// \brief Get column data
+		///
+		/// \tparam N Zero-based column number.
+		/// \return Pointer to the first element of the column.
+		template <std::size_t N>
+		std::tuple_element_t<N, std::tuple<T...> > *data() { return std::get<N>(m_columns).data(); }
+
+		template <std::size_t N>
+		std::tuple_element_t<N, std::tuple<T...> > const *data() const { return std::get<N>(m_columns).data(); }
+
+		/// \brief Get row owner
+		///
+		/// \param [in] row Zero-based row number.
+		/// \return Pointer to the row index of the instance that owns the
+		///   row.
+		std::uint32_t *owner(std::size_t row) const { return m_rows[row]; }
+
+		/// \brief Reserve space for a row
+		///
+		/// Ensures a row can be added without allocating memory.  Must be
+		/// called before \c attach.
+		/// \exception std::bad_alloc Thrown if allocating memory fails.
+		void reserve()
+		{
+			std::size_t const count = m_rows.size() + 1;
+			assert(count <= std::numeric_limits<std::uint32_t>::max());
+			std::size_t const capacity = (std::max)(count, m_rows.capacity() * 2);
+			if (m_rows.capacity() < count)
+				m_rows.reserve(capacity);
+			std::apply(
+					[count, capacity] (auto &... column) { ((column.capacity() < count ? column.reserve(capacity) : void()), ...); },
+					m_columns);
+		}
+
+		/// \brief Add a row
+		///
+		/// Adds a row with value-initialised elements for an instance.
+		/// \param [out] row Row index of the instance.  Receives the
+		///   number of the new row, and is updated if the row moves.
+		void attach(std::uint32_t &row) noexcept
+		{
+			row = std::uint32_t(m_rows.size());
+			m_rows.emplace_back(&row);
+			std::apply([] (auto &... column) { (column.emplace_back(), ...); }, m_columns);
+		}
+
+		/// \brief Remove a row
+		///
+		/// Removes the row for an instance by moving the last row into
+		/// its place, updating the row index of the instance that owned
+		/// the last row.
+		/// \param [in] row Row index of the instance.
+		void detach(std::uint32_t row) noexcept
+		{
+			std::size_t const last = m_rows.size() - 1;
+			if (row != last)
+			{
+				std::apply([row, last] (auto &... column) { ((column[row] = std::move(column[last])), ...); }, m_columns);
+				m_rows[row] = m_rows[last];
+				*m_rows[row] = row;
+			}
+			m_rows.pop_back();
+			std::apply([] (auto &... column) { (column.pop_back(), ...); }, m_columns);
+		}
+
+	private:
+		std::tuple<std::vector<T>...> m_columns;    ///< Extra data columns
+		std::vector<std::uint32_t *> m_rows;        ///< Row index of instance owning each row
+	};
+
+	/// \brief Column instance layout properties
+	///
+	/// Gets the column storage and element types for the column
+	/// instance layout.  Column storage is empty for other layouts.
+	/// \tparam Extra The extra data type.
+	template <typename Extra>
+	struct column_layout
+	{
+		static constexpr bool value = false;
+		using storage = std::tuple<>;
+		using types = std::tuple<>;
+	};
+
+	template <typename... T>
+	struct column_layout<dynamic_derived_class_columns<T...> >
+	{
+		static constexpr bool value = true;
+		using storage = column_storage<T...>;
+		using types = std::tuple<T...>;
+	};
+
 	template <class Base, typename Extra>
 	class value_type
 	{
@@ -253,6 +638,20 @@ protected:
 			return resolved.first(resolved.second, std::forward<T>(args)...);
 		}
 
+		template <class Mixin, typename R, typename... T, typename = std::enable_if_t<!std::is_same_v<Mixin, Base> > >
+		R call_base_member_function(R (Mixin::*func)(T...), T... args)
+		{
+			auto const resolved = dynamic_derived_class_base::resolve_secondary_base_member_function(base, func);
+			return resolved.first(resolved.second, std::forward<T>(args)...);
+		}
+
+		template <class Mixin, typename R, typename... T, typename = std::enable_if_t<!std::is_same_v<Mixin, Base> > >
+		R call_base_member_function(R (Mixin::*func)(T...) const, T... args) const
+		{
+			auto const resolved = dynamic_derived_class_base::resolve_secondary_base_member_function(base, func);
+			return resolved.first(resolved.second, std::forward<T>(args)...);
+		}
+
 		Base base;
 		Extra extra;
 	};
@@ -291,9 +690,215 @@ protected:
 			return resolved.first(resolved.second, std::forward<T>(args)...);
 		}
 
+		template <class Mixin, typename R, typename... T, typename = std::enable_if_t<!std::is_same_v<Mixin, Base> > >
+		R call_base_member_function(R (Mixin::*func)(T...), T... args)
+		{
+			auto const resolved = dynamic_derived_class_base::resolve_secondary_base_member_function(base, func);
+			return resolved.first(resolved.second, std::forward<T>(args)...);
+		}
+
+		template <class Mixin, typename R, typename... T, typename = std::enable_if_t<!std::is_same_v<Mixin, Base> > >
+		R call_base_member_function(R (Mixin::*func)(T...) const, T... args) const
+		{
+			auto const resolved = dynamic_derived_class_base::resolve_secondary_base_member_function(base, func);
+			return resolved.first(resolved.second, std::forward<T>(args)...);
+		}
+
 		Base base;
 	};
 
+	template <class Base, typename Extra, std::size_t Alignment>
+	class alignas(Alignment) value_type<Base, dynamic_derived_class_aligned<Extra, Alignment> > : public value_type<Base, Extra>
+	{
+	public:
+		using value_type<Base, Extra>::value_type;
+	};
+
+	template <class Base, typename Extra>
+	class value_type<Base, dynamic_derived_class_tracked<Extra> > : public value_type<Base, Extra>
+	{
+		static_assert(!is_layout_wrapper<Extra>::value, "Tracked layout may not be combined with other instance layouts");
+
+	public:
+		using value_type<Base, Extra>::value_type;
+
+		/// \brief Get offset to instance link
+		///
+		/// Gets the offset from the start of the value type to the link
+		/// used to track the instance.
+		/// \return Offset to the instance link in bytes.
+		static std::ptrdiff_t link_offset()
+		{
+			return
+					reinterpret_cast<std::uint8_t *>(&reinterpret_cast<value_type *>(std::uintptr_t(0))->link) -
+					reinterpret_cast<std::uint8_t *>(reinterpret_cast<value_type *>(std::uintptr_t(0)));
+		}
+
+		instance_link link;
+	};
+
+	template <class Base, typename... T>
+	class value_type<Base, dynamic_derived_class_columns<T...> > : public value_type<Base, void>
+	{
+	public:
+		using value_type<Base, void>::value_type;
+
+		/// \brief Get offset to row index
+		///
+		/// Gets the offset from the start of the value type to the row
+		/// index of the instance.
+		/// \return Offset to the row index in bytes.
+		static std::ptrdiff_t row_offset()
+		{
+			return
+					reinterpret_cast<std::uint8_t *>(&reinterpret_cast<value_type *>(std::uintptr_t(0))->row) -
+					reinterpret_cast<std::uint8_t *>(reinterpret_cast<value_type *>(std::uintptr_t(0)));
+		}
+
+		/// \brief Get column storage
+		///
+		/// Gets the columns owned by the dynamic derived class of the
+		/// instance.
+		/// \return A reference to the column storage.
+		column_storage<T...> &columns() const
+		{
+			return static_cast<column_storage<T...> &>(*get_class(this->base).features()->columns);
+		}
+
+		/// \brief Get extra data element
+		///
+		/// Gets the element of a column for the instance.  The reference
+		/// is invalidated if any instance of the class is created or
+		/// destroyed.
+		/// \tparam N Zero-based column number.
+		/// \return A reference to the element.
+		template <std::size_t N>
+		std::tuple_element_t<N, std::tuple<T...> > &column()
+		{
+			return columns().template data<N>()[row];
+		}
+
+		template <std::size_t N>
+		std::tuple_element_t<N, std::tuple<T...> > const &column() const
+		{
+			return columns().template data<N>()[row];
+		}
+
+		std::uint32_t row;
+	};
+
+	template <class Base, typename Extra, std::size_t Alignment>
+	class value_type<Base, dynamic_derived_class_prefix<Extra, Alignment> > : public value_type<Base, void>
+	{
+	public:
+		struct storage;
+
+		using value_type<Base, void>::value_type;
+
+		Extra &extra();
+		Extra const &extra() const;
+	};
+
+	/// \brief Instance storage management
+	///
+	/// Allocates, destroys and frees the storage for instances of dynamic
+	/// derived classes.  Instances are allocated individually with the
+	/// base class at the start of the value type.
+	/// \tparam Base The base class type.
+	/// \tparam Extra The extra data type.
+	template <class Base, typename Extra>
+	struct instance_storage
+	{
+		using type = value_type<Base, Extra>;
+
+		template <typename... T>
+		static type *create(T &&... args);
+
+		static void destruct(type &object);
+		static void deallocate(type *object);
+		static void destroy(type *object);
+	};
+
+	/// \brief Instance storage management for prefix layout
+	///
+	/// Allocates, destroys and frees the storage for instances of dynamic
+	/// derived classes where the extra data precedes the base class.
+	/// \tparam Base The base class type.
+	/// \tparam Extra The extra data type.
+	/// \tparam Alignment Required alignment for the storage in bytes.
+	template <class Base, typename Extra, std::size_t Alignment>
+	struct instance_storage<Base, dynamic_derived_class_prefix<Extra, Alignment> >
+	{
+		using type = value_type<Base, dynamic_derived_class_prefix<Extra, Alignment> >;
+
+		template <typename... T>
+		static type *create(T &&... args);
+
+		static void destruct(type &object);
+		static void deallocate(type *object);
+		static void destroy(type *object);
+
+		static typename type::storage &get_storage(type &object);
+	};
+
+	/// \brief Remove instance from list if tracked
+	///
+	/// Removes an instance from the list of instances of the dynamic
+	/// derived class that owns it, or releases its row for the column
+	/// instance layout.  Has no effect for other instance layouts.  Must
+	/// be called before the base class virtual table pointer is
+	/// restored.
+	/// \tparam Base The base class type.
+	/// \tparam Extra The extra data type.
+	template <class Base, typename Extra>
+	static void detach_instance(value_type<Base, Extra> &)
+	{
+	}
+
+	template <class Base, typename Extra>
+	static void detach_instance(value_type<Base, dynamic_derived_class_tracked<Extra> > &object)
+	{
+		unlink_instance(object.link);
+	}
+
+	template <class Base, typename... T>
+	static void detach_instance(value_type<Base, dynamic_derived_class_columns<T...> > &object)
+	{
+		object.columns().detach(object.row);
+	}
+
+	template <typename ParentExtra, typename Extra, typename Enable = void>
+	struct is_layered_extra_compatible_impl : std::false_type { };
+
+	template <typename Extra>
+	struct is_layered_extra_compatible_impl<void, Extra, void> : std::true_type { };
+
+	template <typename ParentExtra, typename Extra>
+	struct is_layered_extra_compatible_impl<
+			ParentExtra,
+			Extra,
+			std::enable_if_t<
+				(alignof(ParentExtra) == alignof(Extra)) &&
+				(std::is_same_v<ParentExtra, Extra> || std::is_base_of_v<ParentExtra, Extra>)> > : std::true_type
+	{
+	};
+
+	/// \brief Check extra data types for layered classes
+	///
+	/// Checks whether instances with the specified extra data type can
+	/// be passed to member functions overridden in a dynamic derived
+	/// class with the parent extra data type.  The parent extra data
+	/// type must be \c void, the same as the extra data type, or a base
+	/// class of the extra data type with the same alignment requirement.
+	/// Alternate instance layouts are not supported.
+	/// \tparam ParentExtra Extra data type of the parent class.
+	/// \tparam Extra Extra data type of the layered class.
+	template <typename ParentExtra, typename Extra>
+	using is_layered_extra_compatible = std::conjunction<
+			std::negation<is_layout_wrapper<ParentExtra> >,
+			std::negation<is_layout_wrapper<Extra> >,
+			is_layered_extra_compatible_impl<ParentExtra, Extra> >;
+
 	template <class Base, typename Extra, typename Enable = void>
 	struct destroyer;
 
@@ -318,6 +923,12 @@ protected:
 		static void *MAME_ABI_CXX_MEMBER_CALL scalar_deleting_destructor(
 				value_type<Base, Extra> *object,
 				unsigned int flags);
+
+		static void MAME_ABI_CXX_MEMBER_CALL secondary_complete_object_destructor(
+				void *object);
+
+		static void MAME_ABI_CXX_MEMBER_CALL secondary_deleting_destructor(
+				void *object);
 	};
 
 	/// \brief Destroyer for base classes without virtual destructors
@@ -337,27 +948,397 @@ protected:
 		void operator()(Base *object) const;
 	};
 
-	dynamic_derived_class_base(std::string_view name);
+	/// \brief Secondary virtual table
+	///
+	/// Describes the virtual table used for a base class of the base
+	/// class that does not share the primary virtual table pointer.
+	/// Only supported for the Itanium C++ ABI.
+	struct secondary_vtable
+	{
+		std::ptrdiff_t offset;                      ///< Offset to secondary base class within base class
+		std::size_t first_overridable;              ///< Number of member function entries for the virtual destructor
+		std::size_t virtual_count;                  ///< Number of overridable virtual member functions
+		std::unique_ptr<std::uintptr_t []> vtable;  ///< Virtual table followed by overridden flags
+		std::uintptr_t const *base_vtable;          ///< Saved base class secondary virtual table pointer
+
+		/// \brief Get virtual table pointer for instances
+		///
+		/// Gets the value for the secondary virtual table pointer of
+		/// instances of the dynamic derived class.
+		/// \return Pointer to the first virtual member function entry in
+		///   the secondary virtual table.
+		std::uintptr_t const *instance_vptr() const
+		{
+			return &vtable[VTABLE_PREFIX_ENTRIES];
+		}
+	};
+
+	/// \brief Instance reference count shard
+	///
+	/// Counts references held by instances for the sharded reference
+	/// counting mode.  Each shard occupies its own cache line so threads
+	/// creating and destroying instances in different shards do not
+	/// contend.
+	struct alignas(64) reference_shard
+	{
+		std::atomic<std::size_t> count = 0;         ///< Number of instances counted in this shard
+	};
+
+	static constexpr std::size_t REFERENCE_SHARDS = 16;
+
+	/// \brief Virtual table replica
+	///
+	/// Copy of the virtual table used by instances created by threads in
+	/// one replica group.  The copy is aligned to a cache line and padded
+	/// to a whole number of cache lines, so changes to the class's
+	/// virtual table and copies for other groups do not share cache
+	/// lines with it.  The copy is refreshed lazily when its epoch falls
+	/// behind the class's virtual table epoch.
+	struct alignas(64) vtable_replica
+	{
+		std::atomic<std::uint64_t> epoch = 0;       ///< Virtual table epoch the copy was made at
+		std::atomic<bool> busy = false;             ///< Set while the copy is being refreshed
+		std::unique_ptr<std::uintptr_t []> storage; ///< Storage for the copy including space for alignment
+		std::uintptr_t *vtable = nullptr;           ///< Cache line aligned copy of the virtual table
+
+		/// \brief Get virtual table pointer for instances
+		///
+		/// Gets the value for the virtual table pointer of instances
+		/// using the replica.
+		/// \return Pointer to the first virtual member function entry in
+		///   the copy of the virtual table.
+		std::uintptr_t const *instance_vptr() const
+		{
+			return &vtable[VTABLE_PREFIX_ENTRIES];
+		}
+	};
+
+	static constexpr std::size_t REPLICA_LINE_ENTRIES = 64 / sizeof(std::uintptr_t);
+
+	/// \brief Statistics counters
+	///
+	/// Counters maintained for each dynamic derived class, and for all
+	/// instances of dynamic derived classes.  All counters are updated
+	/// with relaxed memory ordering.  Declared whether or not statistics
+	/// are enabled, so the layout of classes does not change.
+	struct stat_counters
+	{
+		std::atomic<std::size_t> live_instances = 0;
+		std::atomic<std::size_t> peak_instances = 0;
+		std::atomic<std::size_t> instances_created = 0;
+		std::atomic<std::size_t> instances_destroyed = 0;
+		std::atomic<std::size_t> overrides = 0;
+		std::atomic<std::size_t> restores = 0;
+
+		void add_live_instances(std::size_t count)
+		{
+			std::size_t const live = live_instances.fetch_add(count, std::memory_order_relaxed) + count;
+			std::size_t peak = peak_instances.load(std::memory_order_relaxed);
+			while ((live > peak) && !peak_instances.compare_exchange_weak(peak, live, std::memory_order_relaxed)) { }
+		}
+	};
+
+	/// \brief Optional feature state
+	///
+	/// State used by layered classes, secondary base classes, instance
+	/// tracking, reference counting, extra data columns, virtual table
+	/// replicas and statistics.  Allocated the first time one of these
+	/// features is enabled for a class, so a class that uses none of
+	/// them only pays for a single pointer.
+	struct feature_state
+	{
+		feature_state()
+		{
+			instances.prev = instances.next = &instances;
+		}
+
+		dynamic_derived_class_base *parent = nullptr;       ///< Parent class for layered dynamic derived classes
+		std::vector<dynamic_derived_class_base *> children; ///< Layered dynamic derived classes using this class as their parent
+		std::vector<secondary_vtable> secondary;            ///< Virtual tables for secondary base classes
+		instance_link instances;                            ///< List of tracked instances
+		std::size_t instance_count = 0;                     ///< Number of tracked instances
+		std::mutex instances_mutex;                         ///< Protects list of tracked instances
+		dynamic_reference_mode reference_mode = dynamic_reference_mode::NONE; ///< How instances hold references to the class
+		std::size_t references = 1;                         ///< Single-thread reference count including owner
+		std::atomic<std::size_t> active_shards = 1;         ///< Number of non-empty shards plus owner for sharded mode
+		std::unique_ptr<reference_shard []> shards;         ///< Instance reference count shards for sharded mode
+		void (*reclaim)(dynamic_derived_class_base &) = nullptr; ///< Destroys the class when released by its owner
+		std::unique_ptr<column_storage_base> columns;       ///< Extra data columns for column instance layout
+		std::atomic<std::uint64_t> vtable_epoch = 0;        ///< Incremented when the virtual table changes
+		std::unique_ptr<vtable_replica []> replicas;        ///< Virtual table replicas for replica groups
+		std::size_t replica_count = 0;                      ///< Number of virtual table replicas, or zero if not replicated
+		std::atomic<bool> replicas_used = false;            ///< Set when an instance is created using a replica
+		stat_counters stats;                                ///< Statistics counters for this class
+	};
+
+	/// \brief Get optional feature state
+	///
+	/// \return Pointer to the optional feature state, or \c nullptr if
+	///   no optional features have been enabled for the class.
+	feature_state *features() const
+	{
+		return m_features.load(std::memory_order_acquire);
+	}
+
+	feature_state &require_features();
+
+	/// \brief Count instance created
+	///
+	/// Updates statistics counters when an instance is created.  Has no
+	/// effect if statistics are disabled.
+	void count_instance_created()
+	{
+#if MAME_DYNAMIC_CLASS_STATS
+		feature_state *const state = features();
+		if (state)
+		{
+			state->stats.instances_created.fetch_add(1, std::memory_order_relaxed);
+			state->stats.add_live_instances(1);
+		}
+		s_total_stats.add_live_instances(1);
+#endif
+	}
+
+	/// \brief Count instance destroyed
+	///
+	/// Updates statistics counters when an instance is destroyed.  Must
+	/// be called before the extra data is destroyed.  Has no effect if
+	/// statistics are disabled.
+	void count_instance_destroyed()
+	{
+#if MAME_DYNAMIC_CLASS_STATS
+		feature_state *const state = features();
+		if (state)
+		{
+			state->stats.instances_destroyed.fetch_add(1, std::memory_order_relaxed);
+			state->stats.live_instances.fetch_sub(1, std::memory_order_relaxed);
+		}
+		s_total_stats.live_instances.fetch_sub(1, std::memory_order_relaxed);
+#endif
+	}
+
+	/// \brief Get reference count shard for instance
+	///
+	/// Selects the reference count shard for an instance from its
+	/// address, so the reference added when the instance is created and
+	/// released when it is destroyed use the same shard.
+	/// \param [in] object Pointer to the base class member of an
+	///   instance.
+	/// \return Index of the reference count shard.
+	static std::size_t reference_shard_index(void const *object)
+	{
+		return (std::uintptr_t(object) >> 12) % REFERENCE_SHARDS;
+	}
+
+	/// \brief Get storage size for virtual table and flags
+	///
+	/// Gets the number of pointer-sized entries required to store the
+	/// virtual table and overridden member function flags.
+	/// \param [in] first_overridable Number of virtual table entries used
+	///   for the virtual destructor, in terms of the size of a virtual
+	///   member function in the virtual table.
+	/// \param [in] virtual_count Number of overridable virtual member
+	///   functions.
+	/// \return The number of pointer-sized entries required.
+	static constexpr std::size_t storage_size(std::size_t first_overridable, std::size_t virtual_count)
+	{
+		return
+				VTABLE_PREFIX_ENTRIES +
+				((first_overridable + virtual_count) * MEMBER_FUNCTION_SIZE) +
+				((virtual_count + OVERRIDDEN_FLAGS_PER_ENTRY - 1) / OVERRIDDEN_FLAGS_PER_ENTRY);
+	}
+
+	dynamic_derived_class_base(std::string_view name, std::size_t first_overridable, std::size_t virtual_count);
 	~dynamic_derived_class_base();
 
+	[[noreturn]] static void throw_error(std::error_code const &err);
+	static std::error_code validate_name(std::string_view name) noexcept;
+	static std::error_code try_resolve_virtual_member_slot(member_function_pointer_equiv &slot, std::size_t size, std::size_t &index) noexcept;
 	static std::size_t resolve_virtual_member_slot(member_function_pointer_equiv &slot, std::size_t size);
 
+	void set_storage(std::uintptr_t *storage);
+	void init_vtable();
+	void copy_vtable(dynamic_derived_class_base const &prototype);
+	void capture_base_vtable(void const *object);
+	void set_parent(dynamic_derived_class_base &parent);
+	secondary_vtable &add_secondary_vtable(std::ptrdiff_t offset, std::size_t first_overridable, std::size_t virtual_count);
+	void set_secondary_vptrs(void *object) const;
+	void link_instance(instance_link &link);
+	static void unlink_instance(instance_link &link);
+	std::size_t retarget_instances(dynamic_derived_class_base &target, std::ptrdiff_t link_offset);
+	void set_reference_mode(dynamic_reference_mode mode);
+	std::size_t reference_count() const;
+	void release_owner_reference(void (*reclaim)(dynamic_derived_class_base &));
+	void add_instance_reference(void const *object);
+	void collect_stats(dynamic_derived_class_stats &stats) const;
+	std::error_code set_replica_count(std::size_t count);
+	std::uintptr_t const *replica_vptr();
+	void refresh_replica();
+	void refresh_replicas();
+	bool is_replica_vptr(std::uintptr_t vptr) const;
+	void journal_change(bool restore, std::ptrdiff_t offset, std::size_t index, std::uintptr_t previous, std::uintptr_t current) const;
+
+	/// \brief Get class if instances hold references
+	///
+	/// Used by destroyers to decide whether a reference needs to be
+	/// released after an instance is destroyed.  If reference counting
+	/// is not enabled, the extra data destructor may destroy the class,
+	/// so it must not be accessed after destroying the instance.
+	/// \return Pointer to this class if reference counting is enabled,
+	///   or \c nullptr otherwise.
+	dynamic_derived_class_base *reference_counted()
+	{
+		feature_state const *const state = features();
+		return (state && (dynamic_reference_mode::NONE != state->reference_mode)) ? this : nullptr;
+	}
+
+	void release_instance_reference(void const *object);
+	std::error_code override_secondary_member_slot(std::ptrdiff_t offset, member_function_pointer_equiv &slot, std::uintptr_t func, std::size_t size);
+	std::error_code restore_secondary_member_slot(std::ptrdiff_t offset, member_function_pointer_equiv &slot, std::size_t size);
+
+	/// \brief Find secondary virtual table
+	///
+	/// Finds the secondary virtual table for the base class at the
+	/// specified offset within the base class.
+	/// \param [in] offset Offset to the secondary base class in bytes.
+	/// \return Pointer to the secondary virtual table, or \c nullptr if
+	///   no secondary base class has been added at the offset.
+	secondary_vtable const *find_secondary_vtable(std::ptrdiff_t offset) const
+	{
+		feature_state const *const state = features();
+		if (!state)
+			return nullptr;
+		auto const found = std::find_if(
+				state->secondary.begin(),
+				state->secondary.end(),
+				[offset] (secondary_vtable const &secondary) { return secondary.offset == offset; });
+		return (state->secondary.end() != found) ? &*found : nullptr;
+	}
+
+	template <class Base, class Mixin>
+	static std::ptrdiff_t secondary_base_offset();
+
+	static void *complete_object(void *object);
+	std::error_code override_virtual_member_slot(member_function_pointer_equiv &slot, std::uintptr_t func, std::size_t size);
+	std::error_code restore_virtual_member_slot(member_function_pointer_equiv &slot, std::size_t size);
+
+	/// \brief Get number of overridable virtual member functions
+	///
+	/// Gets the number of overridable virtual member functions of a
+	/// dynamic derived class, which may have a different type.
+	/// \param [in] cls The dynamic derived class.
+	/// \return The number of overridable virtual member functions.
+	static std::size_t virtual_count(dynamic_derived_class_base const &cls)
+	{
+		return cls.m_virtual_count;
+	}
+
+	/// \brief Get virtual table pointer for instances
+	///
+	/// Gets the value for the virtual table pointer of instances of the
+	/// dynamic derived class.
+	/// \return Pointer to the first virtual member function entry in the
+	///   dynamic derived class virtual table.
+	std::uintptr_t const *instance_vptr() const
+	{
+		return &m_vtable[VTABLE_PREFIX_ENTRIES];
+	}
+
+	template <typename Base>
+	static dynamic_derived_class_base &get_class(Base const &object);
+
+	template <typename Object, typename R, typename... T>
+	static void invoke_virtual_member_function(Object *const *first, Object *const *last, std::size_t index, T... args);
+
+	template <typename Object>
+	static void sort_by_vptr(Object **first, Object **last);
+
 #if MAME_ABI_CXX_TYPE == MAME_ABI_CXX_MSVC
 	msvc_type_info_equiv *m_type_info;
 #else
 	itanium_si_class_type_info_equiv m_type_info;   ///< Type info for the dynamic derived class
 #endif
 	std::string m_name;                             ///< Storage for the class name (mangled for Itanium, undecorated for MSVC)
-	void const *m_base_vtable;                      ///< Saved base class virtual table pointer
+	std::atomic<void const *> m_base_vtable;        ///< Saved base class virtual table pointer, or parent class virtual table pointer
+	std::atomic<void const *> m_root_vtable;        ///< Saved base class virtual table pointer for destruction
+	std::once_flag m_base_vtable_captured;          ///< Ensures base class virtual table is captured once
+	bool m_base_vtable_ready;                       ///< Base class virtual table captured during construction
+	std::atomic<feature_state *> m_features;        ///< Optional feature state, allocated when first needed
+	static stat_counters s_total_stats;             ///< Statistics counters for all instances
+	std::uintptr_t *m_vtable;                       ///< Virtual table followed by overridden flags
+	std::uintptr_t *m_overridden;                   ///< Overridden member function flags
+	std::size_t const m_first_overridable;          ///< Number of member function entries for the virtual destructor
+	std::size_t const m_virtual_count;              ///< Number of overridable virtual member functions
 
 private:
+	friend class util::dynamic_derived_class_profile;
+	friend class util::dynamic_override_cache;
+	friend dynamic_derived_class_stats util::dynamic_derived_class_aggregate_stats();
+
+	static_assert(sizeof(std::atomic<void const *>) == sizeof(void const *), "Atomic pointer must be the same size as a pointer");
+
+	bool is_overridden(std::size_t index) const
+	{
+		return (m_overridden[index / OVERRIDDEN_FLAGS_PER_ENTRY] >> (index % OVERRIDDEN_FLAGS_PER_ENTRY)) & 1;
+	}
+
+	void set_overridden(std::size_t index, bool overridden)
+	{
+		std::uintptr_t const mask = std::uintptr_t(1) << (index % OVERRIDDEN_FLAGS_PER_ENTRY);
+		if (overridden)
+			m_overridden[index / OVERRIDDEN_FLAGS_PER_ENTRY] |= mask;
+		else
+			m_overridden[index / OVERRIDDEN_FLAGS_PER_ENTRY] &= ~mask;
+	}
+
+	/// \brief Get number of entries saved in a profile
+	///
+	/// Gets the number of pointer-sized entries following the virtual
+	/// destructor entries in the virtual table storage.  This covers
+	/// the entries for all overridable member functions followed by the
+	/// overridden member function flags.
+	/// \return The number of pointer-sized entries saved in a profile.
+	std::size_t profile_size() const
+	{
+		return storage_size(m_first_overridable, m_virtual_count) - VTABLE_PREFIX_ENTRIES - (m_first_overridable * MEMBER_FUNCTION_SIZE);
+	}
+
+	/// \brief Get number of entries copied to replicas
+	///
+	/// Gets the number of pointer-sized entries in the virtual table
+	/// storage preceding the overridden member function flags.
+	/// \return The number of pointer-sized entries in a replica.
+	std::size_t replica_size() const
+	{
+		return VTABLE_PREFIX_ENTRIES + ((m_first_overridable + m_virtual_count) * MEMBER_FUNCTION_SIZE);
+	}
+
+	/// \brief Publish virtual table change
+	///
+	/// Advances the virtual table epoch after entries have been changed,
+	/// so virtual table replicas are refreshed the next time they are
+	/// checked.
+	void advance_vtable_epoch()
+	{
+		feature_state *const state = features();
+		if (state)
+			state->vtable_epoch.fetch_add(1, std::memory_order_release);
+	}
+
+	void refresh_replica(vtable_replica &replica);
+	void save_profile(std::uintptr_t *dest) const;
+	void apply_profile(std::uintptr_t const *src);
+	void override_virtual_member_entry(std::size_t index, std::uintptr_t func);
+	void propagate_virtual_member_slot(std::size_t index);
+
 	static std::ptrdiff_t base_vtable_offset();
+	static std::ptrdiff_t recovery_offset();
 
 	template <typename Base>
 	static std::uintptr_t const *get_base_vptr(Base const &object);
 
 	template <typename Base>
-	static void restore_base_vptr(Base &object);
+	static dynamic_derived_class_base &restore_base_vptr(Base &object);
 
 	template <typename Base, typename R, typename... T>
 	static std::pair<R MAME_ABI_CXX_MEMBER_CALL (*)(void *, T...), void *> resolve_base_member_function(
@@ -368,6 +1349,29 @@ private:
 	static std::pair<R MAME_ABI_CXX_MEMBER_CALL (*)(void const *, T...), void const *> resolve_base_member_function(
 			Base const &object,
 			R (Base::*func)(T...) const);
+
+	template <typename Base, class Mixin, typename R, typename... T>
+	static std::pair<R MAME_ABI_CXX_MEMBER_CALL (*)(void *, T...), void *> resolve_secondary_base_member_function(
+			Base &object,
+			R (Mixin::*func)(T...));
+
+	template <typename Base, class Mixin, typename R, typename... T>
+	static std::pair<R MAME_ABI_CXX_MEMBER_CALL (*)(void const *, T...), void const *> resolve_secondary_base_member_function(
+			Base const &object,
+			R (Mixin::*func)(T...) const);
+
+protected:
+	template <typename Base, typename R, typename... T>
+	static std::pair<R MAME_ABI_CXX_MEMBER_CALL (*)(void *, T...), void *> resolve_base_member_function(
+			std::uintptr_t const *base_vtable,
+			Base &object,
+			R (Base::*func)(T...));
+
+	template <typename Base, typename R, typename... T>
+	static std::pair<R MAME_ABI_CXX_MEMBER_CALL (*)(void const *, T...), void const *> resolve_base_member_function(
+			std::uintptr_t const *base_vtable,
+			Base const &object,
+			R (Base::*func)(T...) const);
 };
 
 } // namespace detail
@@ -384,6 +1388,63 @@ private:
 ///
 /// The dynamic derived class object must not be destroyed until after
 /// all instances of the class have been destroyed.
+/// Alternatively, instances can hold references to the class.  After
+/// selecting a reference counting mode with \c set_reference_mode, the
+/// owner can pass ownership of the class to its instances by calling
+/// \c release.  The class is destroyed automatically when its last
+/// instance is destroyed.  This avoids needing the extra data to hold a
+/// shared pointer to the class when many instances share one class.
+///
+/// If the tracked instance layout is used, live instances can be
+/// enumerated, counted, or moved to another compatible class, and
+/// destroying the class while instances remain triggers an assertion.
+///
+/// If the column instance layout is used, the extra data for all
+/// instances is stored in columns owned by the class.  Columns can be
+/// processed in bulk using \c column and \c row_count, and rows can be
+/// mapped back to instances using \c instance_at.  Instances of a class
+/// using the column instance layout must not be created or destroyed
+/// concurrently, or while columns are being accessed.
+///
+/// For workloads that override member functions frequently while many
+/// threads call them, \c set_replica_count gives each replica group
+/// (by default, each NUMA node) its own copy of the virtual table.
+/// Instances dispatch through the copy for the group of the thread that
+/// created them, and overriding a member function only writes the
+/// class's own virtual table.  Changes are published by advancing an
+/// epoch, and each copy is brought up to date when an instance is
+/// created or \c refresh_replica is called by a thread in its group, so
+/// instances using a copy do not see changes until then.  Calling
+/// member functions is not affected.
+///
+/// The base class virtual table is needed to restore base class
+/// implementations of member functions.  If an exemplar instance of the
+/// base class is supplied when creating the dynamic derived class, the
+/// base class virtual table is captured immediately.  Otherwise it is
+/// captured when the first instance is created, and restoring base
+/// class implementations has no effect until then.
+///
+/// Instances may be created concurrently from multiple threads.  The
+/// base class virtual table is captured exactly once, and once it has
+/// been captured creating an instance does not modify the dynamic
+/// derived class.  Overriding or restoring member functions is not
+/// synchronised with other modifications or with capturing the base
+/// class virtual table.  Supply an exemplar if member functions may be
+/// overridden or restored while the first instances are being created.
+///
+/// A dynamic derived class may be layered on another dynamic derived
+/// class with the same base class, known as its parent.  Member
+/// functions that are not overridden in the layered class use the
+/// parent class implementations, including changes made to the parent
+/// class later.  Base class implementations called from member
+/// functions overridden in the layered class resolve to the parent
+/// class implementations.  Member functions overridden in a class used
+/// as a parent must call base class implementations using the
+/// \c call_base_member_function member function of the dynamic derived
+/// class rather than the member function of the instance, as the
+/// instance cannot tell which class in the hierarchy is making the
+/// call.  The parent class must not be destroyed until after all
+/// layered classes using it have been destroyed.
 ///
 /// When destroying an instance of the dynamic derived class, the base
 /// class vtable is restored before the extra data destructor is called.
@@ -400,20 +1461,32 @@ private:
 ///   * Must not have any direct or indirect virtual base classes.
 ///   * Must have no secondary virtual tables.  This means the class and
 ///     all of its direct and indirect base classes may only inherit
-///     virtual member functions from one base class at most.
+///     virtual member functions from one base class at most.  For the
+///     Itanium C++ ABI, this requirement is relaxed for base classes
+///     with secondary virtual tables that are added using
+///     \c add_secondary_base before the base class virtual table is
+///     captured.
 ///   * If the class has a virtual destructor, it must be declared
 ///     declared before any other virtual member functions in the least
 ///     derived base class containing virtual member functions.
 /// \tparam Extra Extra data type, or \c void if not required.  Must be
 ///   a concrete type with at least one public constructor and a public
-///   destructor.
+///   destructor.  May be an instantiation of
+///   \c dynamic_derived_class_aligned, \c dynamic_derived_class_prefix,
+///   \c dynamic_derived_class_tracked or
+///   \c dynamic_derived_class_columns to select an alternate instance
+///   layout.
 /// \tparam VirtualCount The total number of virtual member functions of
 ///   the base class, excluding the virtual destructor if present.  This
 ///   must be correct, and cannot be checked automatically.  It is the
 ///   developer's responsibility to ensure the value is correct.  This
 ///   potentially includes additional entries for overridden member
 ///   functions with covariant return types and implicitly-declared
-///   assignment operators.
+///   assignment operators.  If \c dynamic_virtual_count is used, the
+///   count is supplied when constructing the dynamic derived class, and
+///   the virtual table is allocated dynamically.  This avoids
+///   instantiating templates for each count, and keeps the dynamic
+///   derived class object small.
 template <class Base, typename Extra, std::size_t VirtualCount>
 class dynamic_derived_class : private detail::dynamic_derived_class_base
 {
@@ -421,7 +1494,9 @@ public:
 	/// \brief Type used to store base class and extra data
 	///
 	/// Has a member \c base of the base class type, and a member
-	/// \c extra of the extra data type if it is not \c void.
+	/// \c extra of the extra data type if it is not \c void.  For the
+	/// prefix layout, the extra data is accessed using a member function
+	/// \c extra instead.
 	///
 	/// Provides \c resolve_base_member_function and
 	/// \c call_base_member_function member functions to assist with
@@ -439,8 +1514,14 @@ public:
 	dynamic_derived_class &operator=(dynamic_derived_class const &) = delete;
 
 	dynamic_derived_class(std::string_view name);
+	dynamic_derived_class(std::string_view name, std::size_t virtual_count);
+	dynamic_derived_class(Base const &exemplar, std::string_view name);
+	dynamic_derived_class(Base const &exemplar, std::string_view name, std::size_t virtual_count);
 	dynamic_derived_class(dynamic_derived_class const &prototype, std::string_view name);
 
+	template <typename ParentExtra, std::size_t ParentVirtualCount>
+	dynamic_derived_class(std::string_view name, dynamic_derived_class<Base, ParentExtra, ParentVirtualCount> &parent);
+
 	/// \brief Get type info for dynamic derived class
 	///
 	/// Gets a reference to the type info for the dynamic derived class.
@@ -465,22 +1546,465 @@ public:
 	template <typename R, typename... T>
 	void restore_base_member_function(R (Base::*slot)(T...));
 
+	template <typename R, typename... T>
+	std::error_code try_override_member_function(R (Base::*slot)(T...), R MAME_ABI_CXX_MEMBER_CALL (*func)(type &, T...)) noexcept;
+
+	template <typename R, typename... T>
+	std::error_code try_override_member_function(R (Base::*slot)(T...) const, R MAME_ABI_CXX_MEMBER_CALL (*func)(type const &, T...)) noexcept;
+
+	template <typename R, typename... T>
+	std::error_code try_restore_base_member_function(R (Base::*slot)(T...)) noexcept;
+
+	template <typename R, typename... T>
+	std::error_code try_restore_base_member_function(R (Base::*slot)(T...) const) noexcept;
+
+	template <typename R, typename... T>
+	static std::error_code try_resolve_member_function(R (Base::*slot)(T...), std::size_t &index) noexcept;
+
+	template <typename R, typename... T>
+	static std::error_code try_resolve_member_function(R (Base::*slot)(T...) const, std::size_t &index) noexcept;
+
+	static std::unique_ptr<dynamic_derived_class> try_create(std::string_view name, std::error_code &err) noexcept;
+	static std::unique_ptr<dynamic_derived_class> try_create(std::string_view name, std::size_t virtual_count, std::error_code &err) noexcept;
+
+	template <class Mixin>
+	void add_secondary_base(std::size_t virtual_count);
+
+	template <auto Func, class Mixin, typename R, typename... T>
+	void override_member_function(R (Mixin::*slot)(T...));
+
+	template <auto Func, class Mixin, typename R, typename... T>
+	void override_member_function(R (Mixin::*slot)(T...) const);
+
+	template <class Mixin, typename R, typename... T>
+	void restore_base_member_function(R (Mixin::*slot)(T...));
+
 	template <typename... T>
 	pointer instantiate(type *&object, T &&... args);
 
+	template <typename... T>
+	pointer instantiate_captured(type *&object, T &&... args);
+
+	template <typename R, typename... T>
+	R call_base_member_function(type &object, R (Base::*func)(T...), T... args) const;
+
+	template <typename R, typename... T>
+	R call_base_member_function(type const &object, R (Base::*func)(T...) const, T... args) const;
+
+	/// \brief Test whether an object is an instance of the class
+	///
+	/// Tests whether an object is an instance of this dynamic derived
+	/// class by comparing its virtual table pointer.  This is less
+	/// expensive than comparing type info.  If virtual table replicas
+	/// are enabled, an object that does not use the class's own virtual
+	/// table is compared against each replica in turn, so the cost for
+	/// instances using replicas and for objects that are not instances
+	/// grows with the number of replicas.
+	/// \param [in] object Reference to an object of the base class type.
+	/// \return True if the object is an instance of this dynamic derived
+	///   class, or false otherwise.
+	bool is_instance(Base const &object) const
+	{
+		std::uintptr_t const vptr = *reinterpret_cast<std::uintptr_t const *>(&object);
+		if (vptr == std::uintptr_t(instance_vptr()))
+			return true;
+		feature_state const *const state = features();
+		return state && state->replica_count && is_replica_vptr(vptr);
+	}
+
+	static dynamic_derived_class &from_instance(Base const &object);
+
+	std::size_t instance_count() const;
+
+	template <typename Func>
+	void for_each_instance(Func &&func);
+
+	template <std::size_t TargetVirtualCount>
+	std::size_t retarget_instances(dynamic_derived_class<Base, Extra, TargetVirtualCount> &target);
+
+	std::size_t row_count() const;
+
+	template <std::size_t N>
+	std::tuple_element_t<N, typename column_layout<Extra>::types> *column();
+
+	template <std::size_t N>
+	std::tuple_element_t<N, typename column_layout<Extra>::types> const *column() const;
+
+	type &instance_at(std::size_t row);
+
+	void set_reference_mode(dynamic_reference_mode mode);
+	std::size_t reference_count() const;
+	static void release(std::unique_ptr<dynamic_derived_class> &&cls);
+
+	void set_replica_count(std::size_t count);
+	std::size_t replica_count() const;
+	void refresh_replica();
+	void refresh_replicas();
+
+	dynamic_derived_class_stats stats() const;
+
+	template <typename R, typename... T>
+	static void invoke_member_function(Base *const *first, Base *const *last, R (Base::*slot)(T...), T... args);
+
+	template <typename R, typename... T>
+	static void invoke_member_function(Base const *const *first, Base const *const *last, R (Base::*slot)(T...) const, T... args);
+
+	static void sort_by_class(Base **first, Base **last);
+	static void sort_by_class(Base const **first, Base const **last);
+
 private:
+	template <class, typename, std::size_t> friend class dynamic_derived_class;
+	template <class, typename, std::size_t, class, class...> friend class static_dynamic_class;
+	friend class dynamic_derived_class_profile;
+	friend class dynamic_override_cache;
+
 	static_assert(sizeof(std::uintptr_t) == sizeof(std::ptrdiff_t), "Pointer and pointer difference must be the same size");
 	static_assert(sizeof(void *) == sizeof(void (*)()), "Code and data pointers must be the same size");
 	static_assert(std::is_polymorphic_v<Base>, "Base class must be polymorphic");
 
+	static constexpr bool DYNAMIC_VIRTUAL_COUNT = VirtualCount == dynamic_virtual_count;
 	static constexpr std::size_t FIRST_OVERRIDABLE_MEMBER_OFFSET = std::has_virtual_destructor_v<Base> ? VTABLE_DESTRUCTOR_ENTRIES : 0;
-	static constexpr std::size_t VIRTUAL_MEMBER_FUNCTION_COUNT = VirtualCount + FIRST_OVERRIDABLE_MEMBER_OFFSET;
-	static constexpr std::size_t VTABLE_SIZE = VTABLE_PREFIX_ENTRIES + (VIRTUAL_MEMBER_FUNCTION_COUNT * MEMBER_FUNCTION_SIZE);
+	static constexpr std::size_t STORAGE_SIZE = DYNAMIC_VIRTUAL_COUNT ? 0 : storage_size(FIRST_OVERRIDABLE_MEMBER_OFFSET, VirtualCount);
+
+	using storage_type = std::conditional_t<
+			DYNAMIC_VIRTUAL_COUNT,
+			std::unique_ptr<std::uintptr_t []>,
+			std::array<std::uintptr_t, STORAGE_SIZE> >;
+
+	void allocate_storage();
+	void init_destructor_entries();
+
+	/// \brief Get extra data columns
+	///
+	/// Only available if the column instance layout is used.
+	/// \return A reference to the column storage.
+	typename column_layout<Extra>::storage &extra_columns() const
+	{
+		return static_cast<typename column_layout<Extra>::storage &>(*features()->columns);
+	}
+
+	template <bool Captured, typename... T>
+	pointer create_instance(type *&object, T &&... args);
+
+	template <auto Func, typename R, typename... T>
+	static R MAME_ABI_CXX_MEMBER_CALL secondary_thunk(void *object, T... args);
+
+	template <auto Func, typename R, typename... T>
+	static R MAME_ABI_CXX_MEMBER_CALL secondary_const_thunk(void const *object, T... args);
+
+	storage_type m_storage;
+};
+
+
+
+/// \brief Dynamic derived class override profile
+///
+/// Saves the overridden member functions of one or more dynamic derived
+/// classes so they can be restored later.  Applying a profile to a
+/// class replaces all its overridable member function entries and
+/// overridden flags in a single pass, which is substantially less
+/// expensive than overriding or restoring member functions
+/// individually.  Member functions that were not overridden when the
+/// profile was saved use the current base class implementation, or
+/// the current parent class implementation for a layered class.
+/// Changed entries are recorded in the installed journal and counted in
+/// the statistics like individual overrides and restorations.  This is
+/// useful for switching a set of classes between modes that use
+/// different combinations of overrides.
+///
+/// A profile holds pointers to the classes saved in it.  A class must
+/// be removed from all profiles it has been saved in before it is
+/// destroyed.  Applying a profile is subject to the same restrictions
+/// as overriding member functions with respect to concurrency.
+class dynamic_derived_class_profile
+{
+public:
+	dynamic_derived_class_profile(std::string_view name);
+
+	dynamic_derived_class_profile(dynamic_derived_class_profile const &) = delete;
+	dynamic_derived_class_profile &operator=(dynamic_derived_class_profile const &) = delete;
+
+	/// \brief Get profile name
+	///
+	/// Gets the name supplied when the profile was created.
+	/// \return A reference to the name of the profile.
+	std::string const &name() const { return m_name; }
+
+	/// \brief Test whether a class has been saved
+	///
+	/// Tests whether the state of the specified class has been saved in
+	/// the profile.
+	/// \param [in] cls The dynamic derived class to look for.
+	/// \return True if the class has been saved in the profile, or false
+	///   otherwise.
+	template <class Base, typename Extra, std::size_t VirtualCount>
+	bool contains(dynamic_derived_class<Base, Extra, VirtualCount> const &cls) const
+	{
+		return find(cls) != m_entries.end();
+	}
+
+	template <class Base, typename Extra, std::size_t VirtualCount>
+	void save(dynamic_derived_class<Base, Extra, VirtualCount> &cls);
+
+	template <class Base, typename Extra, std::size_t VirtualCount>
+	void apply(dynamic_derived_class<Base, Extra, VirtualCount> &cls) const;
+
+	template <class Base, typename Extra, std::size_t VirtualCount>
+	void remove(dynamic_derived_class<Base, Extra, VirtualCount> const &cls);
+
+	void apply() const;
+	void clear();
+
+private:
+	/// \brief Saved class state
+	///
+	/// Describes the state saved for a dynamic derived class.  The saved
+	/// virtual table entries and flags are stored in the profile data.
+	struct entry
+	{
+		detail::dynamic_derived_class_base *cls;    ///< The dynamic derived class
+		std::size_t offset;                         ///< Offset to saved entries in profile data
+	};
+
+	std::vector<entry>::const_iterator find(detail::dynamic_derived_class_base const &cls) const;
+	void save(detail::dynamic_derived_class_base &cls);
+	void apply(detail::dynamic_derived_class_base &cls) const;
+	void remove(detail::dynamic_derived_class_base const &cls);
+
+	std::string m_name;                 ///< Name of the profile
+	std::vector<entry> m_entries;       ///< Saved classes
+	std::vector<std::uintptr_t> m_data; ///< Saved virtual table entries and flags
+};
+
+
+
+/// \brief Journal of override changes
+///
+/// Records overrides and restorations of member functions of all
+/// dynamic derived classes in a fixed-size ring buffer while installed.
+/// Recording is lock-free and does not allocate memory, so a journal
+/// can be left installed in production builds.  When the buffer is
+/// full, the oldest events are overwritten.
+///
+/// Events can be copied out with \c snapshot, or formatted as text with
+/// \c dump.  Dumping does not allocate memory or take locks, so it may
+/// be used from a signal handler with a suitable sink.  Events that are
+/// being recorded while dumping or taking a snapshot are skipped.
+///
+/// Only one journal can be installed at a time.  A journal must not be
+/// destroyed while it is installed, or while any thread may still be
+/// recording an event using it.
+class dynamic_derived_class_journal
+{
+public:
+	/// \brief Recorded event
+	struct event
+	{
+		std::uint64_t timestamp;        ///< Steady clock time in nanoseconds
+		std::uint64_t thread;           ///< Sequential identifier for thread that made the change
+		bool restore;                   ///< True if base implementation was restored, false if overridden
+		std::ptrdiff_t offset;          ///< Offset to secondary base class, or zero for primary virtual table
+		std::size_t slot;               ///< Virtual table index of the member function
+		std::uintptr_t previous;        ///< Virtual table entry before the change
+		std::uintptr_t current;         ///< Virtual table entry after the change
+		char class_name[32];            ///< Class name from type info, truncated if necessary
+	};
+
+	/// \brief Text output function for dumping events
+	///
+	/// Called with successive chunks of text.  The text is not
+	/// terminated with a null character.
+	using sink = void (*)(void *param, char const *text, std::size_t length);
+
+	dynamic_derived_class_journal(std::size_t capacity);
+	~dynamic_derived_class_journal();
+
+	dynamic_derived_class_journal(dynamic_derived_class_journal const &) = delete;
+	dynamic_derived_class_journal &operator=(dynamic_derived_class_journal const &) = delete;
+
+	static dynamic_derived_class_journal *install(dynamic_derived_class_journal *journal);
+
+	/// \brief Get installed journal
+	///
+	/// Gets the journal that events are currently being recorded in.
+	/// \return Pointer to the installed journal, or \c nullptr if no
+	///   journal is installed.
+	static dynamic_derived_class_journal *installed()
+	{
+		return s_installed.load(std::memory_order_acquire);
+	}
 
-	void override_member_function(member_function_pointer_equiv &slot, std::uintptr_t func, std::size_t size);
+	/// \brief Get capacity
+	///
+	/// Gets the maximum number of events retained by the journal.
+	/// \return The capacity of the ring buffer in events.
+	std::size_t capacity() const { return m_mask + 1; }
+
+	/// \brief Get number of events recorded
+	///
+	/// Gets the total number of events recorded, including events that
+	/// have been overwritten.
+	/// \return The number of events recorded.
+	std::uint64_t recorded() const { return m_head.load(std::memory_order_relaxed); }
+
+	void record(event const &e) noexcept;
+	std::vector<event> snapshot() const;
+	void dump(sink output, void *param) const noexcept;
+
+private:
+	static constexpr std::size_t EVENT_WORDS = 7 + (sizeof(event::class_name) / sizeof(std::uint64_t));
+
+	/// \brief Ring buffer entry
+	///
+	/// Holds one encoded event.  The sequence number is odd while the
+	/// event is being written, and even once it is complete.
+	struct alignas(64) entry
+	{
+		std::atomic<std::uint64_t> sequence = 0;        ///< Twice the event number plus one while writing
+		std::atomic<std::uint64_t> words[EVENT_WORDS];  ///< Encoded event
+	};
+
+	bool read(std::uint64_t position, event &e) const noexcept;
+
+	static std::atomic<dynamic_derived_class_journal *> s_installed;
+
+	std::unique_ptr<entry []> m_entries;    ///< Ring buffer
+	std::size_t m_mask;                     ///< Capacity minus one
+	std::atomic<std::uint64_t> m_head;      ///< Number of events recorded
+};
+
+
+/// \brief Override known at compile time
+///
+/// Describes an override for a dynamic derived class with a fixed set
+/// of overrides.  Used as a template argument for
+/// \c static_dynamic_class.
+/// \tparam Slot Pointer to the base class virtual member function to
+///   override.
+/// \tparam Func Pointer to the function to call in place of the base
+///   class member function.  Must be suitable for passing to
+///   \c override_member_function along with \p Slot.
+template <auto Slot, auto Func>
+struct dynamic_override
+{
+	/// \brief Apply override
+	///
+	/// Overrides the member function in the specified class.
+	/// \param [in,out] cls The dynamic derived class to override the
+	///   member function in.
+	template <class Class>
+	static void apply(Class &cls)
+	{
+		cls.override_member_function(Slot, Func);
+	}
+};
+
+
+/// \brief Capture base class virtual table from an exemplar
+///
+/// Use as one of the overrides for \c static_dynamic_class to construct
+/// a temporary value-initialised instance of the base class when the
+/// class is built, and capture the base class virtual table from it.
+/// Creating instances then does not need to check whether the base
+/// class virtual table has been captured.  The base class must be
+/// default constructible and destructible, and constructing and
+/// destroying an instance must not have unwanted side effects.
+struct dynamic_capture_exemplar
+{
+	/// \brief Apply override
+	///
+	/// Has no effect.  The exemplar is constructed before overrides are
+	/// applied.
+	template <class Class>
+	static void apply(Class &)
+	{
+	}
+};
+
+
+/// \brief Dynamic derived class with overrides known at compile time
+///
+/// Convenience wrapper providing a single dynamic derived class with a
+/// name and set of overrides fixed at compile time.  The class is
+/// created and the overrides are applied in a single pass the first
+/// time it is used.  The virtual table is stored in the class object,
+/// which has static storage duration, so no memory is allocated for it.
+///
+/// This is not a class emitted as constant data.  Entries for member
+/// functions that are not overridden must be copied from the base
+/// class virtual table, which is not available until run time, and the
+/// class is built by thread-safe static initialisation.  By default,
+/// the base class virtual table is captured from the first instance
+/// created, as usual.  If \c dynamic_capture_exemplar is included in the
+/// overrides, a temporary instance of the base class is constructed
+/// during initialisation as an exemplar, so the base class virtual
+/// table is captured along with the overrides and creating instances
+/// does not need to check whether it has been captured.
+///
+/// The class can be used anywhere a dynamic derived class of the same
+/// type can be used.  It must not be released or destroyed, and
+/// reference counting must not be enabled for it.
+/// \tparam Base Base class for the dynamic derived class.
+/// \tparam Extra Extra data type, or \c void if not required.
+/// \tparam VirtualCount The total number of virtual member functions of
+///   the base class, excluding the virtual destructor if present.  May
+///   not be \c dynamic_virtual_count.
+/// \tparam Name Type with a static member \c value convertible to
+///   \c std::string_view supplying the unmangled class name.
+/// \tparam Overrides Zero or more \c dynamic_override types describing
+///   the member functions to override, optionally including
+///   \c dynamic_capture_exemplar.
+template <class Base, typename Extra, std::size_t VirtualCount, class Name, class... Overrides>
+class static_dynamic_class
+{
+public:
+	static_assert(dynamic_virtual_count != VirtualCount, "Virtual member function count must be known at compile time");
+
+	using class_type = dynamic_derived_class<Base, Extra, VirtualCount>;
+	using type = typename class_type::type;
+	using pointer = typename class_type::pointer;
+
+	static_dynamic_class() = delete;
+
+	static class_type &get();
+
+	/// \brief Get type info for dynamic derived class
+	///
+	/// Gets a reference to the type info for the dynamic derived class.
+	/// \return Reference to the type info.
+	static std::type_info const &type_info()
+	{
+		return get().type_info();
+	}
+
+	/// \brief Create a new instance
+	///
+	/// Creates a new instance of the dynamic derived class.
+	/// \param [out] object Receives a pointer to the new instance.
+	/// \param [in] args Arguments to supply to the constructors.
+	/// \return Pointer to the base class of the new instance.
+	template <typename... T>
+	static pointer instantiate(type *&object, T &&... args)
+	{
+		return get().template create_instance<EXEMPLAR>(object, std::forward<T>(args)...);
+	}
+
+	/// \brief Test whether an object is an instance
+	///
+	/// Tests whether an object is an instance of the dynamic derived
+	/// class.
+	/// \param [in] object Reference to an object of the base class type.
+	/// \return True if the object is an instance of the class, or false
+	///   otherwise.
+	static bool is_instance(Base const &object)
+	{
+		return get().is_instance(object);
+	}
+
+private:
+	static constexpr bool EXEMPLAR = std::disjunction_v<std::is_same<Overrides, dynamic_capture_exemplar>...>;
 
-	std::array<std::uintptr_t, VTABLE_SIZE> m_vtable;
-	std::bitset<VirtualCount> m_overridden;
+	static_assert(!EXEMPLAR || (std::is_default_constructible_v<Base> && std::is_destructible_v<Base>), "Exemplar capture requires a default constructible and destructible base class");
 };
 
 } // namespace util
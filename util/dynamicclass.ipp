@@ -31,6 +31,25 @@ inline std::ptrdiff_t dynamic_derived_class_base::base_vtable_offset()
 }
 
 
+/// \brief Get offset to dynamic derived class from recovery entry
+///
+/// Gets the offset from the start of the dynamic derived class object
+/// to the location the dynamic derived class virtual table entry used
+/// for recovery points to.
+/// \return Offset from the start of the dynamic derived class object
+///   to the location the recovery entry points to in bytes.
+inline std::ptrdiff_t dynamic_derived_class_base::recovery_offset()
+{
+	return
+#if MAME_ABI_CXX_TYPE == MAME_ABI_CXX_MSVC
+			reinterpret_cast<std::uint8_t *>(&reinterpret_cast<dynamic_derived_class_base *>(std::uintptr_t(0))->m_base_vtable) -
+#else
+			reinterpret_cast<std::uint8_t *>(&reinterpret_cast<dynamic_derived_class_base *>(std::uintptr_t(0))->m_type_info) -
+#endif
+			reinterpret_cast<std::uint8_t *>(reinterpret_cast<dynamic_derived_class_base *>(std::uintptr_t(0)));
+}
+
+
 /// \brief Get base class virtual table pointer
 ///
 /// Gets the base class virtual pointer for an instance of a dynamic
@@ -46,7 +65,26 @@ inline std::uintptr_t const *dynamic_derived_class_base::get_base_vptr(
 {
 	auto const vptr = *reinterpret_cast<std::uintptr_t const *>(&object);
 	auto const recovery = reinterpret_cast<std::uintptr_t const *>(vptr)[VTABLE_BASE_RECOVERY_INDEX];
-	return *reinterpret_cast<std::uintptr_t const *const *>(recovery + base_vtable_offset());
+	auto const &base = *reinterpret_cast<std::atomic<void const *> const *>(recovery + base_vtable_offset());
+	return reinterpret_cast<std::uintptr_t const *>(base.load(std::memory_order_relaxed));
+}
+
+
+/// \brief Get dynamic derived class for instance
+///
+/// Gets the dynamic derived class an instance belongs to using the
+/// virtual table entry used for recovery.
+/// \tparam Base The base class type (usually determined automatically).
+/// \param [in] object Base class member of dynamic derived class
+///   instance.
+/// \return A reference to the dynamic derived class.
+template <class Base>
+inline dynamic_derived_class_base &dynamic_derived_class_base::get_class(
+		Base const &object)
+{
+	auto const vptr = *reinterpret_cast<std::uintptr_t const *>(&object);
+	auto const recovery = reinterpret_cast<std::uintptr_t const *>(vptr)[VTABLE_BASE_RECOVERY_INDEX];
+	return *reinterpret_cast<dynamic_derived_class_base *>(recovery - recovery_offset());
 }
 
 
@@ -58,14 +96,110 @@ inline std::uintptr_t const *dynamic_derived_class_base::get_base_vptr(
 /// \tparam Base The base class type (usually determined automatically).
 /// \param [in,out] object Base class member of dynamic derived class
 ///   instance.
+/// \return A reference to the dynamic derived class the instance
+///   belonged to.
 template <class Base>
-inline void dynamic_derived_class_base::restore_base_vptr(
+inline dynamic_derived_class_base &dynamic_derived_class_base::restore_base_vptr(
 		Base &object)
 {
+	auto &cls = get_class(object);
 	auto &vptr = *reinterpret_cast<std::uintptr_t *>(&object);
-	auto const recovery = reinterpret_cast<std::uintptr_t const *>(vptr)[VTABLE_BASE_RECOVERY_INDEX];
-	vptr = *reinterpret_cast<std::uintptr_t const *>(recovery + base_vtable_offset());
+	vptr = std::uintptr_t(cls.m_root_vtable.load(std::memory_order_relaxed));
 	assert(reinterpret_cast<void const *>(vptr));
+	feature_state const *const state = cls.features();
+	if (state)
+	{
+		for (secondary_vtable const &secondary : state->secondary)
+			*reinterpret_cast<std::uintptr_t const **>(reinterpret_cast<std::uint8_t *>(&object) + secondary.offset) = secondary.base_vtable;
+	}
+	return cls;
+}
+
+
+/// \brief Add reference held by instance
+///
+/// Counts a reference to the dynamic derived class held by a newly
+/// created instance.  Has no effect if reference counting is not
+/// enabled.  Must only be called once optional feature state has been
+/// allocated.
+/// \param [in] object Pointer to the base class member of the instance.
+inline void dynamic_derived_class_base::add_instance_reference(void const *object)
+{
+	feature_state &state = *features();
+	switch (state.reference_mode)
+	{
+	case dynamic_reference_mode::NONE:
+		break;
+	case dynamic_reference_mode::SINGLE_THREAD:
+		++state.references;
+		break;
+	case dynamic_reference_mode::SHARDED:
+		if (!state.shards[reference_shard_index(object)].count.fetch_add(1, std::memory_order_relaxed))
+			state.active_shards.fetch_add(1, std::memory_order_relaxed);
+		break;
+	}
+}
+
+
+/// \brief Release reference held by instance
+///
+/// Releases a reference to the dynamic derived class held by an
+/// instance that has been destroyed.  If this was the last reference
+/// and the owner has released the class, the class is destroyed.  Has
+/// no effect if reference counting is not enabled.
+/// \param [in] object Pointer to the base class member of the instance.
+///   The instance may already have been destroyed.
+inline void dynamic_derived_class_base::release_instance_reference(void const *object)
+{
+	feature_state &state = *features();
+	switch (state.reference_mode)
+	{
+	case dynamic_reference_mode::NONE:
+		break;
+	case dynamic_reference_mode::SINGLE_THREAD:
+		if (!--state.references)
+			state.reclaim(*this);
+		break;
+	case dynamic_reference_mode::SHARDED:
+		if (1 == state.shards[reference_shard_index(object)].count.fetch_sub(1, std::memory_order_acq_rel))
+		{
+			if (1 == state.active_shards.fetch_sub(1, std::memory_order_acq_rel))
+				state.reclaim(*this);
+		}
+		break;
+	}
+}
+
+
+/// \brief Get offset to secondary base class
+///
+/// Gets the offset to a base class within another class.  The base
+/// class must be a non-virtual base class.
+/// \tparam Base The derived class type.
+/// \tparam Mixin The base class type.
+/// \return Offset from the start of the derived class to the base class
+///   in bytes.
+template <class Base, class Mixin>
+inline std::ptrdiff_t dynamic_derived_class_base::secondary_base_offset()
+{
+	// use a non-null address so the conversion doesn't preserve a null pointer
+	auto const object = reinterpret_cast<Base *>(std::uintptr_t(alignof(Base)));
+	return reinterpret_cast<std::uint8_t *>(static_cast<Mixin *>(object)) - reinterpret_cast<std::uint8_t *>(object);
+}
+
+
+/// \brief Get complete object from secondary base class
+///
+/// Gets a pointer to the complete object using the offset to top from
+/// the virtual table of a polymorphic base class subobject.
+///
+/// Only used for the Itanium C++ ABI.
+/// \param [in] object Pointer to a polymorphic base class subobject.
+/// \return Pointer to the complete object.
+inline void *dynamic_derived_class_base::complete_object(void *object)
+{
+	auto const vptr = *reinterpret_cast<std::ptrdiff_t const *const *>(object);
+	return reinterpret_cast<std::uint8_t *>(object) + vptr[-2];
 }
 
 
@@ -91,13 +225,22 @@ template <typename Base, typename R, typename... T>
 inline std::pair<R MAME_ABI_CXX_MEMBER_CALL (*)(void *, T...), void *> dynamic_derived_class_base::resolve_base_member_function(
 		Base &object,
 		R (Base::*func)(T...))
+{
+	return resolve_base_member_function(get_base_vptr(object), object, func);
+}
+
+template <typename Base, typename R, typename... T>
+inline std::pair<R MAME_ABI_CXX_MEMBER_CALL (*)(void *, T...), void *> dynamic_derived_class_base::resolve_base_member_function(
+		std::uintptr_t const *base_vtable,
+		Base &object,
+		R (Base::*func)(T...))
 {
 	static_assert(supported_return_type<R>::value, "Unsupported member function return type");
 	member_function_pointer_pun_t<decltype(func)> thunk;
 	thunk.ptr = func;
 #if MAME_ABI_CXX_TYPE == MAME_ABI_CXX_MSVC
 	std::size_t const index = resolve_virtual_member_slot(thunk.equiv, sizeof(func));
-	auto const vptr = reinterpret_cast<std::uintptr_t const *>(get_base_vptr(object));
+	auto const vptr = base_vtable;
 	std::uintptr_t const* const entryptr = vptr + (index * MEMBER_FUNCTION_SIZE);
 	return std::make_pair(
 				MAME_ABI_CXX_VTABLE_FNDESC
@@ -108,7 +251,7 @@ inline std::pair<R MAME_ABI_CXX_MEMBER_CALL (*)(void *, T...), void *> dynamic_d
 	if (thunk.equiv.is_virtual())
 	{
 		assert(!thunk.equiv.this_pointer_offset());
-		auto const vptr = reinterpret_cast<std::uint8_t const *>(get_base_vptr(object));
+		auto const vptr = reinterpret_cast<std::uint8_t const *>(base_vtable);
 		auto const entryptr = reinterpret_cast<std::uintptr_t const *>(vptr + thunk.equiv.virtual_table_entry_offset());
 		return std::make_pair(
 				MAME_ABI_CXX_VTABLE_FNDESC
@@ -129,13 +272,22 @@ template <typename Base, typename R, typename... T>
 inline std::pair<R MAME_ABI_CXX_MEMBER_CALL (*)(void const *, T...), void const *> dynamic_derived_class_base::resolve_base_member_function(
 		Base const &object,
 		R (Base::*func)(T...) const)
+{
+	return resolve_base_member_function(get_base_vptr(object), object, func);
+}
+
+template <typename Base, typename R, typename... T>
+inline std::pair<R MAME_ABI_CXX_MEMBER_CALL (*)(void const *, T...), void const *> dynamic_derived_class_base::resolve_base_member_function(
+		std::uintptr_t const *base_vtable,
+		Base const &object,
+		R (Base::*func)(T...) const)
 {
 	static_assert(supported_return_type<R>::value, "Unsupported member function return type");
 	member_function_pointer_pun_t<decltype(func)> thunk;
 	thunk.ptr = func;
 #if MAME_ABI_CXX_TYPE == MAME_ABI_CXX_MSVC
 	std::size_t const index = resolve_virtual_member_slot(thunk.equiv, sizeof(func));
-	auto const vptr = reinterpret_cast<std::uintptr_t const *>(get_base_vptr(object));
+	auto const vptr = base_vtable;
 	std::uintptr_t const* const entryptr = vptr + (index * MEMBER_FUNCTION_SIZE);
 	return std::make_pair(
 				MAME_ABI_CXX_VTABLE_FNDESC
@@ -146,7 +298,7 @@ inline std::pair<R MAME_ABI_CXX_MEMBER_CALL (*)(void const *, T...), void const
 	if (thunk.equiv.is_virtual())
 	{
 		assert(!thunk.equiv.this_pointer_offset());
-		auto const vptr = reinterpret_cast<std::uint8_t const *>(get_base_vptr(object));
+		auto const vptr = reinterpret_cast<std::uint8_t const *>(base_vtable);
 		auto const entryptr = reinterpret_cast<std::uintptr_t const *>(vptr + thunk.equiv.virtual_table_entry_offset());
 		return std::make_pair(
 				MAME_ABI_CXX_VTABLE_FNDESC
@@ -164,6 +316,345 @@ inline std::pair<R MAME_ABI_CXX_MEMBER_CALL (*)(void const *, T...), void const
 }
 
 
+/// \brief Resolve pointer to secondary base class member function
+///
+/// Given an instance and pointer to a member function of a base class
+/// of the base class, gets the adjusted \c this pointer and
+/// conventional function pointer for the base class implementation.
+/// If the member function's class shares the primary virtual table of
+/// the base class, this is equivalent to resolving a pointer to a base
+/// class member function.  Otherwise, its secondary base class must
+/// have been added to the dynamic derived class.
+///
+/// Only supported for the Itanium C++ ABI.
+/// \tparam Base The base class type (usually determined automatically).
+/// \tparam Mixin The class the member function belongs to (usually
+///   determined automatically).
+/// \tparam R Return type of member function (usually determined
+///   automatically).
+/// \tparam T Parameter types expected by the member function (usually
+///   determined automatically).
+/// \param [in] object Base class member of dynamic derived class
+///   instance.
+/// \param [in] func Pointer to member function of secondary base class.
+/// \return A \c std::pair containing the conventional function pointer
+///   and adjusted \c this pointer.
+/// \exception std::invalid_argument Thrown if the \p func argument is
+///   not a supported member function, or the secondary base class has
+///   not been added.
+template <typename Base, class Mixin, typename R, typename... T>
+inline std::pair<R MAME_ABI_CXX_MEMBER_CALL (*)(void *, T...), void *> dynamic_derived_class_base::resolve_secondary_base_member_function(
+		Base &object,
+		R (Mixin::*func)(T...))
+{
+	static_assert(std::is_base_of_v<Mixin, Base>, "Member function must belong to a base class of the base class");
+	std::ptrdiff_t const offset = secondary_base_offset<Base, Mixin>();
+	if (!offset)
+		return resolve_base_member_function(object, static_cast<R (Base::*)(T...)>(func));
+
+	static_assert((MAME_ABI_CXX_TYPE != MAME_ABI_CXX_MSVC) && sizeof(Mixin), "Secondary base classes are not supported for the MSVC C++ ABI");
+	auto const secondary = get_class(object).find_secondary_vtable(offset);
+	if (!secondary)
+		throw_error(dynamic_class_error::SECONDARY_BASE_NOT_ADDED);
+	member_function_pointer_pun_t<decltype(func)> thunk;
+	thunk.ptr = func;
+	auto const mixin = reinterpret_cast<std::uint8_t *>(&object) + offset;
+	if (thunk.equiv.is_virtual())
+	{
+		assert(!thunk.equiv.this_pointer_offset());
+		auto const vptr = reinterpret_cast<std::uint8_t const *>(secondary->base_vtable);
+		auto const entryptr = reinterpret_cast<std::uintptr_t const *>(vptr + thunk.equiv.virtual_table_entry_offset());
+		return std::make_pair(
+				MAME_ABI_CXX_VTABLE_FNDESC
+					? reinterpret_cast<R MAME_ABI_CXX_MEMBER_CALL (*)(void *, T...)>(std::uintptr_t(entryptr))
+					: reinterpret_cast<R MAME_ABI_CXX_MEMBER_CALL (*)(void *, T...)>(*entryptr),
+				mixin);
+	}
+	else
+	{
+		return std::make_pair(
+				reinterpret_cast<R MAME_ABI_CXX_MEMBER_CALL (*)(void *, T...)>(thunk.equiv.function_pointer()),
+				mixin + thunk.equiv.this_pointer_offset());
+	}
+}
+
+template <typename Base, class Mixin, typename R, typename... T>
+inline std::pair<R MAME_ABI_CXX_MEMBER_CALL (*)(void const *, T...), void const *> dynamic_derived_class_base::resolve_secondary_base_member_function(
+		Base const &object,
+		R (Mixin::*func)(T...) const)
+{
+	static_assert(std::is_base_of_v<Mixin, Base>, "Member function must belong to a base class of the base class");
+	std::ptrdiff_t const offset = secondary_base_offset<Base, Mixin>();
+	if (!offset)
+		return resolve_base_member_function(object, static_cast<R (Base::*)(T...) const>(func));
+
+	static_assert((MAME_ABI_CXX_TYPE != MAME_ABI_CXX_MSVC) && sizeof(Mixin), "Secondary base classes are not supported for the MSVC C++ ABI");
+	auto const secondary = get_class(object).find_secondary_vtable(offset);
+	if (!secondary)
+		throw_error(dynamic_class_error::SECONDARY_BASE_NOT_ADDED);
+	member_function_pointer_pun_t<decltype(func)> thunk;
+	thunk.ptr = func;
+	auto const mixin = reinterpret_cast<std::uint8_t const *>(&object) + offset;
+	if (thunk.equiv.is_virtual())
+	{
+		assert(!thunk.equiv.this_pointer_offset());
+		auto const vptr = reinterpret_cast<std::uint8_t const *>(secondary->base_vtable);
+		auto const entryptr = reinterpret_cast<std::uintptr_t const *>(vptr + thunk.equiv.virtual_table_entry_offset());
+		return std::make_pair(
+				MAME_ABI_CXX_VTABLE_FNDESC
+					? reinterpret_cast<R MAME_ABI_CXX_MEMBER_CALL (*)(void const *, T...)>(std::uintptr_t(entryptr))
+					: reinterpret_cast<R MAME_ABI_CXX_MEMBER_CALL (*)(void const *, T...)>(*entryptr),
+				mixin);
+	}
+	else
+	{
+		return std::make_pair(
+				reinterpret_cast<R MAME_ABI_CXX_MEMBER_CALL (*)(void const *, T...)>(thunk.equiv.function_pointer()),
+				mixin + thunk.equiv.this_pointer_offset());
+	}
+}
+
+
+/// \brief Call virtual member function for multiple objects
+///
+/// Calls a virtual member function for each object in a range, in
+/// order.  The virtual table entry is only loaded again when the
+/// virtual table pointer differs from that of the previous object, so
+/// it is loaded once for each run of objects sharing a virtual table.
+/// \tparam Object The base class type, optionally const-qualified.
+/// \tparam R Return type of the member function.
+/// \tparam T Parameter types expected by the member function.
+/// \param [in] first Pointer to the first object pointer in the range.
+/// \param [in] last Pointer past the last object pointer in the range.
+/// \param [in] index Virtual table index of the member function, in
+///   terms of the size of a virtual member function in the virtual
+///   table.
+/// \param [in] args Arguments to pass to the member function for each
+///   object.
+template <typename Object, typename R, typename... T>
+inline void dynamic_derived_class_base::invoke_virtual_member_function(
+		Object *const *first,
+		Object *const *last,
+		std::size_t index,
+		T... args)
+{
+	using function_type = R MAME_ABI_CXX_MEMBER_CALL (*)(Object *, T...);
+	std::uintptr_t const *group = nullptr;
+	function_type func = nullptr;
+	for ( ; last != first; ++first)
+	{
+#if defined(__GNUC__)
+		if (std::next(first) != last)
+			__builtin_prefetch(first[1]);
+#endif
+		auto const vptr = *reinterpret_cast<std::uintptr_t const *const *>(*first);
+		if (vptr != group)
+		{
+			std::uintptr_t const *const entryptr = vptr + (index * MEMBER_FUNCTION_SIZE);
+			func = MAME_ABI_CXX_VTABLE_FNDESC
+					? reinterpret_cast<function_type>(std::uintptr_t(entryptr))
+					: reinterpret_cast<function_type>(*entryptr);
+			group = vptr;
+		}
+		func(*first, args...);
+	}
+}
+
+
+/// \brief Sort objects by virtual table pointer
+///
+/// Reorders a range of object pointers so objects sharing a virtual
+/// table are contiguous.  The relative order of objects sharing a
+/// virtual table is preserved.
+/// \tparam Object The base class type, optionally const-qualified.
+/// \param [in,out] first Pointer to the first object pointer in the
+///   range.
+/// \param [in,out] last Pointer past the last object pointer in the
+///   range.
+template <typename Object>
+inline void dynamic_derived_class_base::sort_by_vptr(Object **first, Object **last)
+{
+	std::stable_sort(
+			first,
+			last,
+			[] (Object *a, Object *b)
+			{
+				return *reinterpret_cast<std::uintptr_t const *>(a) < *reinterpret_cast<std::uintptr_t const *>(b);
+			});
+}
+
+
+/// \brief Storage for instance with extra data preceding base class
+///
+/// Holds the extra data followed by the value type containing the base
+/// class.  The value type is the address used for the instance.
+/// \tparam Base The base class type.
+/// \tparam Extra The extra data type.
+/// \tparam Alignment Required alignment for the storage in bytes.
+template <class Base, typename Extra, std::size_t Alignment>
+struct alignas(Alignment) dynamic_derived_class_base::value_type<Base, dynamic_derived_class_prefix<Extra, Alignment> >::storage
+{
+private:
+	template <typename... T, typename... U, std::size_t... N, std::size_t... O>
+	storage(
+			std::tuple<T...> &a,
+			std::tuple<U...> &b,
+			std::integer_sequence<std::size_t, N...>,
+			std::integer_sequence<std::size_t, O...>) :
+		extra(std::forward<U>(std::get<O>(b))...),
+		value(std::forward<T>(std::get<N>(a))...)
+	{
+	}
+
+public:
+	template <typename... T>
+	storage(T &&... a) :
+		value(std::forward<T>(a)...)
+	{
+	}
+
+	template <typename... T, typename... U>
+	storage(std::piecewise_construct_t, std::tuple<T...> a, std::tuple<U...> b) :
+		storage(a, b, std::make_integer_sequence<std::size_t, sizeof...(T)>(), std::make_integer_sequence<std::size_t, sizeof...(U)>())
+	{
+	}
+
+	static std::ptrdiff_t value_offset()
+	{
+		return
+				reinterpret_cast<std::uint8_t *>(&reinterpret_cast<storage *>(std::uintptr_t(0))->value) -
+				reinterpret_cast<std::uint8_t *>(reinterpret_cast<storage *>(std::uintptr_t(0)));
+	}
+
+	Extra extra;
+	value_type value;
+};
+
+
+/// \brief Get extra data for instance with prefix layout
+///
+/// Gets the extra data stored immediately before the base class.
+/// \return A reference to the extra data.
+template <class Base, typename Extra, std::size_t Alignment>
+inline Extra &dynamic_derived_class_base::value_type<Base, dynamic_derived_class_prefix<Extra, Alignment> >::extra()
+{
+	return instance_storage<Base, dynamic_derived_class_prefix<Extra, Alignment> >::get_storage(*this).extra;
+}
+
+template <class Base, typename Extra, std::size_t Alignment>
+inline Extra const &dynamic_derived_class_base::value_type<Base, dynamic_derived_class_prefix<Extra, Alignment> >::extra() const
+{
+	return instance_storage<Base, dynamic_derived_class_prefix<Extra, Alignment> >::get_storage(const_cast<value_type &>(*this)).extra;
+}
+
+
+/// \brief Allocate and construct an instance
+///
+/// Allocates storage for an instance and constructs the base class and
+/// extra data.
+/// \tparam T Constructor argument types (usually determined
+///   automatically).
+/// \param [in] args Constructor arguments for the value type.
+/// \return A pointer to the new instance.
+template <class Base, typename Extra>
+template <typename... T>
+inline typename dynamic_derived_class_base::instance_storage<Base, Extra>::type *dynamic_derived_class_base::instance_storage<Base, Extra>::create(
+		T &&... args)
+{
+	return new type(std::forward<T>(args)...);
+}
+
+
+/// \brief Destroy an instance without freeing storage
+///
+/// Calls the extra data and base class destructors without freeing the
+/// memory occupied by the instance.
+/// \param [in] object Reference to the instance to destroy.
+template <class Base, typename Extra>
+inline void dynamic_derived_class_base::instance_storage<Base, Extra>::destruct(
+		type &object)
+{
+	object.~type();
+}
+
+
+/// \brief Free storage for a destroyed instance
+///
+/// Frees the memory occupied by an instance that has already been
+/// destroyed.
+/// \param [in] object Pointer to the destroyed instance.
+template <class Base, typename Extra>
+inline void dynamic_derived_class_base::instance_storage<Base, Extra>::deallocate(
+		type *object)
+{
+	if constexpr (alignof(type) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+		operator delete (static_cast<void *>(object), std::align_val_t(alignof(type)));
+	else
+		operator delete (static_cast<void *>(object));
+}
+
+
+/// \brief Destroy an instance and free storage
+///
+/// Calls the extra data and base class destructors, and frees the
+/// memory occupied by the instance.
+/// \param [in] object Pointer to the instance to destroy.
+template <class Base, typename Extra>
+inline void dynamic_derived_class_base::instance_storage<Base, Extra>::destroy(
+		type *object)
+{
+	delete object;
+}
+
+
+template <class Base, typename Extra, std::size_t Alignment>
+template <typename... T>
+inline typename dynamic_derived_class_base::instance_storage<Base, dynamic_derived_class_prefix<Extra, Alignment> >::type *dynamic_derived_class_base::instance_storage<Base, dynamic_derived_class_prefix<Extra, Alignment> >::create(
+		T &&... args)
+{
+	return &(new typename type::storage(std::forward<T>(args)...))->value;
+}
+
+template <class Base, typename Extra, std::size_t Alignment>
+inline void dynamic_derived_class_base::instance_storage<Base, dynamic_derived_class_prefix<Extra, Alignment> >::destruct(
+		type &object)
+{
+	get_storage(object).~storage();
+}
+
+template <class Base, typename Extra, std::size_t Alignment>
+inline void dynamic_derived_class_base::instance_storage<Base, dynamic_derived_class_prefix<Extra, Alignment> >::deallocate(
+		type *object)
+{
+	void *const block = &get_storage(*object);
+	if constexpr (alignof(typename type::storage) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+		operator delete (block, std::align_val_t(alignof(typename type::storage)));
+	else
+		operator delete (block);
+}
+
+template <class Base, typename Extra, std::size_t Alignment>
+inline void dynamic_derived_class_base::instance_storage<Base, dynamic_derived_class_prefix<Extra, Alignment> >::destroy(
+		type *object)
+{
+	delete &get_storage(*object);
+}
+
+
+/// \brief Get storage for instance with prefix layout
+///
+/// Gets the storage containing an instance of a dynamic derived class
+/// where the extra data precedes the base class.
+/// \param [in] object Reference to the instance.
+/// \return A reference to the storage containing the instance.
+template <class Base, typename Extra, std::size_t Alignment>
+inline typename dynamic_derived_class_base::instance_storage<Base, dynamic_derived_class_prefix<Extra, Alignment> >::type::storage &dynamic_derived_class_base::instance_storage<Base, dynamic_derived_class_prefix<Extra, Alignment> >::get_storage(
+		type &object)
+{
+	return *reinterpret_cast<typename type::storage *>(reinterpret_cast<std::uint8_t *>(&object) - type::storage::value_offset());
+}
+
+
 /// \brief Complete object destructor for dynamic derived class
 ///
 /// Restores the base class virtual table pointer, calls the extra data
@@ -178,8 +669,13 @@ template <class Base, typename Extra>
 void MAME_ABI_CXX_MEMBER_CALL dynamic_derived_class_base::destroyer<Base, Extra, std::enable_if_t<std::has_virtual_destructor_v<Base> > >::complete_object_destructor(
 		value_type<Base, Extra> &object)
 {
-	restore_base_vptr(object.base);
-	object.~value_type();
+	detach_instance(object);
+	dynamic_derived_class_base &cls = restore_base_vptr(object.base);
+	cls.count_instance_destroyed();
+	dynamic_derived_class_base *const counted = cls.reference_counted();
+	instance_storage<Base, Extra>::destruct(object);
+	if (counted)
+		counted->release_instance_reference(&object.base);
 }
 
 
@@ -197,8 +693,14 @@ template <class Base, typename Extra>
 void MAME_ABI_CXX_MEMBER_CALL dynamic_derived_class_base::destroyer<Base, Extra, std::enable_if_t<std::has_virtual_destructor_v<Base> > >::deleting_destructor(
 		value_type<Base, Extra> *object)
 {
-	restore_base_vptr(object->base);
-	delete object;
+	detach_instance(*object);
+	dynamic_derived_class_base &cls = restore_base_vptr(object->base);
+	cls.count_instance_destroyed();
+	dynamic_derived_class_base *const counted = cls.reference_counted();
+	void const *const address = &object->base;
+	instance_storage<Base, Extra>::destroy(object);
+	if (counted)
+		counted->release_instance_reference(address);
 }
 
 
@@ -220,14 +722,54 @@ void *MAME_ABI_CXX_MEMBER_CALL dynamic_derived_class_base::destroyer<Base, Extra
 		value_type<Base, Extra> *object,
 		unsigned int flags)
 {
-	restore_base_vptr(object->base);
-	object->~value_type();
+	detach_instance(*object);
+	dynamic_derived_class_base &cls = restore_base_vptr(object->base);
+	cls.count_instance_destroyed();
+	dynamic_derived_class_base *const counted = cls.reference_counted();
+	void const *const address = &object->base;
+	instance_storage<Base, Extra>::destruct(*object);
 	if (flags & 1)
-		operator delete (static_cast<void *>(object));
+		instance_storage<Base, Extra>::deallocate(object);
+	if (counted)
+		counted->release_instance_reference(address);
 	return object;
 }
 
 
+/// \brief Complete object destructor for secondary base class
+///
+/// Adjusts the \c this pointer from a secondary base class subobject to
+/// the complete object and calls the complete object destructor.  Used
+/// in secondary virtual tables when the secondary base class has a
+/// virtual destructor.
+///
+/// Only used for the Itanium C++ ABI.
+/// \param [in] object Pointer to the secondary base class subobject.
+template <class Base, typename Extra>
+void MAME_ABI_CXX_MEMBER_CALL dynamic_derived_class_base::destroyer<Base, Extra, std::enable_if_t<std::has_virtual_destructor_v<Base> > >::secondary_complete_object_destructor(
+		void *object)
+{
+	complete_object_destructor(*reinterpret_cast<value_type<Base, Extra> *>(complete_object(object)));
+}
+
+
+/// \brief Deleting destructor for secondary base class
+///
+/// Adjusts the \c this pointer from a secondary base class subobject to
+/// the complete object and calls the deleting destructor.  Used in
+/// secondary virtual tables when the secondary base class has a virtual
+/// destructor.
+///
+/// Only used for the Itanium C++ ABI.
+/// \param [in] object Pointer to the secondary base class subobject.
+template <class Base, typename Extra>
+void MAME_ABI_CXX_MEMBER_CALL dynamic_derived_class_base::destroyer<Base, Extra, std::enable_if_t<std::has_virtual_destructor_v<Base> > >::secondary_deleting_destructor(
+		void *object)
+{
+	deleting_destructor(reinterpret_cast<value_type<Base, Extra> *>(complete_object(object)));
+}
+
+
 /// \brief Deleter for dynamic derived classes
 ///
 /// Restores the base class virtual table pointer, calls the extra data
@@ -239,8 +781,13 @@ template <class Base, typename Extra>
 void dynamic_derived_class_base::destroyer<Base, Extra, std::enable_if_t<!std::has_virtual_destructor_v<Base> > >::operator()(
 		Base *object) const
 {
-	restore_base_vptr(*object);
-	delete reinterpret_cast<value_type<Base, Extra> *>(object);
+	detach_instance(*reinterpret_cast<value_type<Base, Extra> *>(object));
+	dynamic_derived_class_base &cls = restore_base_vptr(*object);
+	cls.count_instance_destroyed();
+	dynamic_derived_class_base *const counted = cls.reference_counted();
+	instance_storage<Base, Extra>::destroy(reinterpret_cast<value_type<Base, Extra> *>(object));
+	if (counted)
+		counted->release_instance_reference(object);
 }
 
 } // namespace detail
@@ -249,61 +796,107 @@ void dynamic_derived_class_base::destroyer<Base, Extra, std::enable_if_t<!std::h
 /// \brief Create a dynamic derived class
 ///
 /// Creates a new dynamic derived class.  No base member functions are
-/// overridden initially.
+/// overridden initially.  May not be used if the virtual member
+/// function count is supplied at run time.
 /// \param [in] name The unmangled name for the new dynamic derived
 ///   class.  This will be mangled for use in the generated type info.
+/// \exception std::invalid_argument Thrown if the class name is invalid
+///   or unsupported.
 template <class Base, typename Extra, std::size_t VirtualCount>
 dynamic_derived_class<Base, Extra, VirtualCount>::dynamic_derived_class(
 		std::string_view name) :
-	detail::dynamic_derived_class_base(name)
+	dynamic_derived_class(name, VirtualCount)
 {
-#if MAME_ABI_CXX_TYPE == MAME_ABI_CXX_MSVC
-	m_vtable[0] = std::uintptr_t(&m_base_vtable); // for restoring the base vtable
-#else
+	static_assert(!DYNAMIC_VIRTUAL_COUNT, "Virtual member function count must be supplied");
+}
+
+
+/// \brief Create a dynamic derived class with a virtual member count
+///
+/// Creates a new dynamic derived class.  No base member functions are
+/// overridden initially.
+/// \param [in] name The unmangled name for the new dynamic derived
+///   class.  This will be mangled for use in the generated type info.
+/// \param [in] virtual_count The total number of virtual member
+///   functions of the base class, excluding the virtual destructor if
+///   present.  Must match the \p VirtualCount template argument unless
+///   it is \c dynamic_virtual_count.
+/// \exception std::invalid_argument Thrown if the class name is invalid
+///   or unsupported, or the virtual member function count does not match
+///   the template argument.
+template <class Base, typename Extra, std::size_t VirtualCount>
+dynamic_derived_class<Base, Extra, VirtualCount>::dynamic_derived_class(
+		std::string_view name,
+		std::size_t virtual_count) :
+	detail::dynamic_derived_class_base(name, FIRST_OVERRIDABLE_MEMBER_OFFSET, virtual_count)
+{
+	if (!DYNAMIC_VIRTUAL_COUNT && (VirtualCount != virtual_count))
+		throw_error(dynamic_class_error::VIRTUAL_COUNT_MISMATCH);
+	allocate_storage();
+#if MAME_ABI_CXX_TYPE != MAME_ABI_CXX_MSVC
 	m_type_info.base_type = &typeid(Base);
-	m_vtable[0] = 0; // offset to top
-	m_vtable[1] = std::uintptr_t(&m_type_info); // type info
 #endif
-	if constexpr (std::has_virtual_destructor_v<Base>)
-	{
-		if (MAME_ABI_CXX_TYPE == MAME_ABI_CXX_MSVC)
-		{
-			if (MAME_ABI_CXX_VTABLE_FNDESC)
-			{
-				std::copy_n(
-						reinterpret_cast<std::uintptr_t const *>(std::uintptr_t(&destroyer<Base, Extra>::scalar_deleting_destructor)),
-						MEMBER_FUNCTION_SIZE,
-						&m_vtable[VTABLE_PREFIX_ENTRIES]);
-			}
-			else
-			{
-				m_vtable[VTABLE_PREFIX_ENTRIES] = std::uintptr_t(&destroyer<Base, Extra>::scalar_deleting_destructor);
-			}
-		}
-		else
-		{
-			if (MAME_ABI_CXX_VTABLE_FNDESC)
-			{
-				std::copy_n(
-						reinterpret_cast<std::uintptr_t const *>(std::uintptr_t(&destroyer<Base, Extra>::complete_object_destructor)),
-						MEMBER_FUNCTION_SIZE,
-						&m_vtable[VTABLE_PREFIX_ENTRIES]);
-				std::copy_n(
-						reinterpret_cast<std::uintptr_t const *>(std::uintptr_t(&destroyer<Base, Extra>::deleting_destructor)),
-						MEMBER_FUNCTION_SIZE,
-						&m_vtable[VTABLE_PREFIX_ENTRIES + MEMBER_FUNCTION_SIZE]);
-			}
-			else
-			{
-				m_vtable[VTABLE_PREFIX_ENTRIES] = std::uintptr_t(&destroyer<Base, Extra>::complete_object_destructor);
-				m_vtable[VTABLE_PREFIX_ENTRIES + 1] = std::uintptr_t(&destroyer<Base, Extra>::deleting_destructor);
-			}
-		}
-	}
-	std::fill(
-			std::next(m_vtable.begin(), VTABLE_PREFIX_ENTRIES + (FIRST_OVERRIDABLE_MEMBER_OFFSET * MEMBER_FUNCTION_SIZE)),
-			m_vtable.end(),
-			std::uintptr_t(static_cast<void *>(nullptr)));
+	init_vtable();
+	init_destructor_entries();
+}
+
+
+/// \brief Create a dynamic derived class using an exemplar
+///
+/// Creates a new dynamic derived class, capturing the base class
+/// virtual table from an existing instance of the base class.  No base
+/// member functions are overridden initially.  Base class
+/// implementations of member functions can be restored before any
+/// instances of the dynamic derived class have been created.  May not
+/// be used if the virtual member function count is supplied at run
+/// time.
+/// \param [in] exemplar An instance of the base class.  The most
+///   derived type of the object must be the base class type.  It is
+///   only used during construction, and need not outlive the dynamic
+///   derived class.
+/// \param [in] name The unmangled name for the new dynamic derived
+///   class.  This will be mangled for use in the generated type info.
+/// \exception std::invalid_argument Thrown if the most derived type of
+///   the exemplar is not the base class type, or if the class name is
+///   invalid or unsupported.
+template <class Base, typename Extra, std::size_t VirtualCount>
+dynamic_derived_class<Base, Extra, VirtualCount>::dynamic_derived_class(
+		Base const &exemplar,
+		std::string_view name) :
+	dynamic_derived_class(exemplar, name, VirtualCount)
+{
+	static_assert(!DYNAMIC_VIRTUAL_COUNT, "Virtual member function count must be supplied");
+}
+
+
+/// \brief Create a dynamic derived class using an exemplar
+///
+/// Creates a new dynamic derived class, capturing the base class
+/// virtual table from an existing instance of the base class.  No base
+/// member functions are overridden initially.
+/// \param [in] exemplar An instance of the base class.  The most
+///   derived type of the object must be the base class type.
+/// \param [in] name The unmangled name for the new dynamic derived
+///   class.  This will be mangled for use in the generated type info.
+/// \param [in] virtual_count The total number of virtual member
+///   functions of the base class, excluding the virtual destructor if
+///   present.  Must match the \p VirtualCount template argument unless
+///   it is \c dynamic_virtual_count.
+/// \exception std::invalid_argument Thrown if the most derived type of
+///   the exemplar is not the base class type, if the class name is
+///   invalid or unsupported, or if the virtual member function count
+///   does not match the template argument.
+template <class Base, typename Extra, std::size_t VirtualCount>
+dynamic_derived_class<Base, Extra, VirtualCount>::dynamic_derived_class(
+		Base const &exemplar,
+		std::string_view name,
+		std::size_t virtual_count) :
+	dynamic_derived_class(name, virtual_count)
+{
+	if (typeid(exemplar) != typeid(Base))
+		throw_error(dynamic_class_error::INVALID_EXEMPLAR);
+	capture_base_vtable(&exemplar);
+	m_base_vtable_ready = true;
 }
 
 
@@ -320,21 +913,132 @@ dynamic_derived_class<Base, Extra, VirtualCount>::dynamic_derived_class(
 ///   prototype.
 /// \param [in] name The unmangled name for the new dynamic derived
 ///   class.  This will be mangled for use in the generated type info.
+/// \exception std::invalid_argument Thrown if the class name is invalid
+///   or unsupported.
 template <class Base, typename Extra, std::size_t VirtualCount>
 dynamic_derived_class<Base, Extra, VirtualCount>::dynamic_derived_class(
 		dynamic_derived_class const &prototype,
 		std::string_view name) :
-	detail::dynamic_derived_class_base(name),
-	m_vtable(prototype.m_vtable),
-	m_overridden(prototype.m_overridden)
+	detail::dynamic_derived_class_base(name, FIRST_OVERRIDABLE_MEMBER_OFFSET, prototype.m_virtual_count)
 {
-	m_base_vtable = prototype.m_base_vtable;
-#if MAME_ABI_CXX_TYPE == MAME_ABI_CXX_MSVC
-	m_vtable[0] = std::uintptr_t(&m_base_vtable); // for restoring the base vtable
-#else
-	m_type_info.base_type = &typeid(Base);
-	m_vtable[1] = std::uintptr_t(&m_type_info); // type info
+	allocate_storage();
+#if MAME_ABI_CXX_TYPE != MAME_ABI_CXX_MSVC
+	m_type_info.base_type = prototype.m_type_info.base_type; // parent class type info if the prototype is layered
 #endif
+	copy_vtable(prototype);
+	m_base_vtable_ready = nullptr != m_root_vtable.load(std::memory_order_acquire);
+}
+
+
+/// \brief Create a dynamic derived class layered on another
+///
+/// Creates a new dynamic derived class using another dynamic derived
+/// class with the same base class as its parent.  Initially, no member
+/// functions are overridden in the new class, and instances behave
+/// like instances of the parent class.  Base class implementations
+/// called from member functions overridden in the new class resolve to
+/// the parent class implementations.  The type info for the new class
+/// identifies the parent class as its base class.
+/// \tparam ParentExtra Extra data type of the parent class (usually
+///   determined automatically).  Must be \c void, the same as the extra
+///   data type, or a base class of the extra data type with the same
+///   alignment requirement.
+/// \tparam ParentVirtualCount The virtual member function count of the
+///   parent class (usually determined automatically).
+/// \param [in] name The unmangled name for the new dynamic derived
+///   class.  This will be mangled for use in the generated type info.
+/// \param [in] parent The dynamic derived class to use as the parent.
+///   Must not be destroyed until after the new dynamic derived class is
+///   destroyed.
+/// \exception std::invalid_argument Thrown if the class name is invalid
+///   or unsupported, or the virtual member function count of the parent
+///   class does not match the template argument.
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <typename ParentExtra, std::size_t ParentVirtualCount>
+dynamic_derived_class<Base, Extra, VirtualCount>::dynamic_derived_class(
+		std::string_view name,
+		dynamic_derived_class<Base, ParentExtra, ParentVirtualCount> &parent) :
+	detail::dynamic_derived_class_base(
+			name,
+			FIRST_OVERRIDABLE_MEMBER_OFFSET,
+			virtual_count(static_cast<detail::dynamic_derived_class_base &>(parent)))
+{
+	static_assert(is_layered_extra_compatible<ParentExtra, Extra>::value, "Extra data type is not compatible with parent class");
+	static_assert(
+			DYNAMIC_VIRTUAL_COUNT || (ParentVirtualCount == dynamic_virtual_count) || (ParentVirtualCount == VirtualCount),
+			"Virtual member function count does not match parent class");
+	if (!DYNAMIC_VIRTUAL_COUNT && (VirtualCount != m_virtual_count))
+		throw_error(dynamic_class_error::VIRTUAL_COUNT_MISMATCH);
+	allocate_storage();
+#if MAME_ABI_CXX_TYPE != MAME_ABI_CXX_MSVC
+	m_type_info.base_type = &parent.type_info();
+#endif
+	init_vtable();
+	init_destructor_entries();
+	set_parent(static_cast<detail::dynamic_derived_class_base &>(parent));
+	m_base_vtable_ready = nullptr != m_root_vtable.load(std::memory_order_acquire);
+}
+
+
+/// \brief Create a dynamic derived class without exceptions
+///
+/// Creates a new dynamic derived class, reporting invalid arguments
+/// using an error code rather than throwing an exception.  May not be
+/// used if the virtual member function count is supplied at run time.
+/// \param [in] name The unmangled name for the new dynamic derived
+///   class.  This will be mangled for use in the generated type info.
+/// \param [out] err Receives an error code if the class name is invalid
+///   or unsupported, or memory for the class cannot be allocated, or is
+///   cleared on success.
+/// \return A pointer to the new dynamic derived class, or \c nullptr if
+///   an error occurred.
+template <class Base, typename Extra, std::size_t VirtualCount>
+std::unique_ptr<dynamic_derived_class<Base, Extra, VirtualCount> > dynamic_derived_class<Base, Extra, VirtualCount>::try_create(
+		std::string_view name,
+		std::error_code &err) noexcept
+{
+	static_assert(!DYNAMIC_VIRTUAL_COUNT, "Virtual member function count must be supplied");
+	return try_create(name, VirtualCount, err);
+}
+
+
+/// \brief Create a dynamic derived class without exceptions
+///
+/// Creates a new dynamic derived class, reporting invalid arguments
+/// using an error code rather than throwing an exception.  Arguments
+/// are checked before the class is constructed.  Memory for the type
+/// info and virtual table is still allocated using the global
+/// allocation functions, so running out of memory during construction
+/// terminates the program.
+/// \param [in] name The unmangled name for the new dynamic derived
+///   class.  This will be mangled for use in the generated type info.
+/// \param [in] virtual_count The total number of virtual member
+///   functions of the base class, excluding the virtual destructor if
+///   present.  Must match the \p VirtualCount template argument unless
+///   it is \c dynamic_virtual_count.
+/// \param [out] err Receives an error code if the class name is
+///   invalid or unsupported, the virtual member function count does
+///   not match the template argument, or memory for the class cannot be
+///   allocated, or is cleared on success.
+/// \return A pointer to the new dynamic derived class, or \c nullptr if
+///   an error occurred.
+template <class Base, typename Extra, std::size_t VirtualCount>
+std::unique_ptr<dynamic_derived_class<Base, Extra, VirtualCount> > dynamic_derived_class<Base, Extra, VirtualCount>::try_create(
+		std::string_view name,
+		std::size_t virtual_count,
+		std::error_code &err) noexcept
+{
+	if (!DYNAMIC_VIRTUAL_COUNT && (VirtualCount != virtual_count))
+		err = dynamic_class_error::VIRTUAL_COUNT_MISMATCH;
+	else
+		err = validate_name(name);
+	if (err)
+		return nullptr;
+
+	std::unique_ptr<dynamic_derived_class> result(new (std::nothrow) dynamic_derived_class(name, virtual_count));
+	if (!result)
+		err = std::make_error_code(std::errc::not_enough_memory);
+	return result;
 }
 
 
@@ -344,7 +1048,11 @@ dynamic_derived_class<Base, Extra, VirtualCount>::dynamic_derived_class(
 /// function with the supplied function.  This applies to existing
 /// instances as well as newly created instances.  Note that if you are
 /// using some technique to resolve pointers to virtual member functions
-/// in advance, resolved pointers may not reflect the change.
+/// in advance, resolved pointers may not reflect the change.  If virtual
+/// table replicas are enabled, instances using a replica continue to
+/// call the previous implementation until the replica is refreshed (see
+/// \c set_replica_count).  Call \c refresh_replicas if the change must
+/// be visible through all replicas when this returns.
 /// \tparam R Return type of member function to override (usually
 ///   determined automatically).
 /// \tparam T Parameter types expected by the member function to
@@ -354,7 +1062,8 @@ dynamic_derived_class<Base, Extra, VirtualCount>::dynamic_derived_class(
 /// \param [in] func A pointer to the function to use to override the
 ///   base class member function.
 /// \exception std::invalid_argument Thrown if the \p slot argument is
-///   not a supported virtual member function.
+///   not a supported virtual member function, or its virtual table
+///   index is out of range.
 /// \sa restore_base_member_function
 template <class Base, typename Extra, std::size_t VirtualCount>
 template <typename R, typename... T>
@@ -365,7 +1074,9 @@ void dynamic_derived_class<Base, Extra, VirtualCount>::override_member_function(
 	static_assert(supported_return_type<R>::value, "Unsupported member function return type");
 	member_function_pointer_pun_t<decltype(slot)> thunk;
 	thunk.ptr = slot;
-	override_member_function(thunk.equiv, std::uintptr_t(func), sizeof(func));
+	std::error_code const err = override_virtual_member_slot(thunk.equiv, std::uintptr_t(func), sizeof(func));
+	if (err)
+		throw_error(err);
 }
 
 template <class Base, typename Extra, std::size_t VirtualCount>
@@ -377,7 +1088,9 @@ void dynamic_derived_class<Base, Extra, VirtualCount>::override_member_function(
 	static_assert(supported_return_type<R>::value, "Unsupported member function return type");
 	member_function_pointer_pun_t<decltype(slot)> thunk;
 	thunk.ptr = slot;
-	override_member_function(thunk.equiv, std::uintptr_t(func), sizeof(func));
+	std::error_code const err = override_virtual_member_slot(thunk.equiv, std::uintptr_t(func), sizeof(func));
+	if (err)
+		throw_error(err);
 }
 
 
@@ -388,6 +1101,10 @@ void dynamic_derived_class<Base, Extra, VirtualCount>::override_member_function(
 /// existing instances as well as newly created instances.  Note that if
 /// you are using some technique to resolve pointers to virtual member
 /// functions in advance, resolved pointers may not reflect the change.
+/// If virtual table replicas are enabled, instances using a replica
+/// continue to call the previous implementation until the replica is
+/// refreshed (see \c set_replica_count).  Call \c refresh_replicas if
+/// the change must be visible through all replicas when this returns.
 /// \tparam R Return type of member function to restore (usually
 ///   determined automatically).
 /// \tparam T Parameter types expected by the member function to
@@ -395,33 +1112,344 @@ void dynamic_derived_class<Base, Extra, VirtualCount>::override_member_function(
 /// \param [in] slot A pointer to the base class member function to
 ///   restore.  Must be a pointer to a virtual member function.
 /// \exception std::invalid_argument Thrown if the \p slot argument is
-///   not a supported virtual member function.
+///   not a supported virtual member function, or its virtual table
+///   index is out of range.
 /// \sa override_member_function
 template <class Base, typename Extra, std::size_t VirtualCount>
 template <typename R, typename... T>
 void dynamic_derived_class<Base, Extra, VirtualCount>::restore_base_member_function(
 		R (Base::*slot)(T...))
 {
-	member_function_pointer_pun_t<decltype(slot)>  thunk;
+	member_function_pointer_pun_t<decltype(slot)> thunk;
 	thunk.ptr = slot;
-	std::size_t const index = resolve_virtual_member_slot(thunk.equiv, sizeof(slot));
-	assert(index < VIRTUAL_MEMBER_FUNCTION_COUNT);
-	assert(FIRST_OVERRIDABLE_MEMBER_OFFSET <= index);
-	if (m_overridden[index - FIRST_OVERRIDABLE_MEMBER_OFFSET] && m_base_vtable)
+	std::error_code const err = restore_virtual_member_slot(thunk.equiv, sizeof(slot));
+	if (err)
+		throw_error(err);
+}
+
+
+/// \brief Override a virtual member function without exceptions
+///
+/// Equivalent to \c override_member_function, but reports errors by
+/// returning an error code rather than throwing an exception.  Usable
+/// when exceptions are disabled.
+/// \tparam R Return type of member function to override (usually
+///   determined automatically).
+/// \tparam T Parameter types expected by the member function to
+///   override (usually determined automatically).
+/// \param [in] slot A pointer to the base class member function to
+///   override.  Must be a pointer to a virtual member function.
+/// \param [in] func A pointer to the function to use to override the
+///   base class member function.
+/// \return An error code if the \p slot argument is not a supported
+///   virtual member function, or its virtual table index is out of
+///   range.  The class is not modified if an error is returned.
+/// \sa override_member_function try_restore_base_member_function
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <typename R, typename... T>
+std::error_code dynamic_derived_class<Base, Extra, VirtualCount>::try_override_member_function(
+		R (Base::*slot)(T...),
+		R MAME_ABI_CXX_MEMBER_CALL (*func)(type &, T...)) noexcept
+{
+	static_assert(supported_return_type<R>::value, "Unsupported member function return type");
+	member_function_pointer_pun_t<decltype(slot)> thunk;
+	thunk.ptr = slot;
+	return override_virtual_member_slot(thunk.equiv, std::uintptr_t(func), sizeof(func));
+}
+
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <typename R, typename... T>
+std::error_code dynamic_derived_class<Base, Extra, VirtualCount>::try_override_member_function(
+		R (Base::*slot)(T...) const,
+		R MAME_ABI_CXX_MEMBER_CALL (*func)(type const &, T...)) noexcept
+{
+	static_assert(supported_return_type<R>::value, "Unsupported member function return type");
+	member_function_pointer_pun_t<decltype(slot)> thunk;
+	thunk.ptr = slot;
+	return override_virtual_member_slot(thunk.equiv, std::uintptr_t(func), sizeof(func));
+}
+
+
+/// \brief Restore the base implementation without exceptions
+///
+/// Equivalent to \c restore_base_member_function, but reports errors
+/// by returning an error code rather than throwing an exception.
+/// Usable when exceptions are disabled.
+/// \tparam R Return type of member function to restore (usually
+///   determined automatically).
+/// \tparam T Parameter types expected by the member function to
+///   to restore (usually determined automatically).
+/// \param [in] slot A pointer to the base class member function to
+///   restore.  Must be a pointer to a virtual member function.
+/// \return An error code if the \p slot argument is not a supported
+///   virtual member function, or its virtual table index is out of
+///   range.
+/// \sa restore_base_member_function try_override_member_function
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <typename R, typename... T>
+std::error_code dynamic_derived_class<Base, Extra, VirtualCount>::try_restore_base_member_function(
+		R (Base::*slot)(T...)) noexcept
+{
+	member_function_pointer_pun_t<decltype(slot)> thunk;
+	thunk.ptr = slot;
+	return restore_virtual_member_slot(thunk.equiv, sizeof(slot));
+}
+
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <typename R, typename... T>
+std::error_code dynamic_derived_class<Base, Extra, VirtualCount>::try_restore_base_member_function(
+		R (Base::*slot)(T...) const) noexcept
+{
+	member_function_pointer_pun_t<decltype(slot)> thunk;
+	thunk.ptr = slot;
+	return restore_virtual_member_slot(thunk.equiv, sizeof(slot));
+}
+
+
+/// \brief Get virtual table index for a member function
+///
+/// Gets the index of the virtual table entry for a virtual member
+/// function of the base class, without throwing exceptions.  This can
+/// be used to check in advance whether a member function can be
+/// overridden.
+/// \tparam R Return type of the member function (usually determined
+///   automatically).
+/// \tparam T Parameter types expected by the member function (usually
+///   determined automatically).
+/// \param [in] slot A pointer to a base class member function.
+/// \param [out] index Receives the index of the member function among
+///   the overridable virtual member functions if successful.
+/// \return An error code if the \p slot argument is not a supported
+///   virtual member function, or its virtual table index is out of
+///   range.
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <typename R, typename... T>
+std::error_code dynamic_derived_class<Base, Extra, VirtualCount>::try_resolve_member_function(
+		R (Base::*slot)(T...),
+		std::size_t &index) noexcept
+{
+	member_function_pointer_pun_t<decltype(slot)> thunk;
+	thunk.ptr = slot;
+	std::size_t entry;
+	std::error_code const err = try_resolve_virtual_member_slot(thunk.equiv, sizeof(slot), entry);
+	if (err)
+		return err;
+	if ((entry < FIRST_OVERRIDABLE_MEMBER_OFFSET) || (!DYNAMIC_VIRTUAL_COUNT && ((entry - FIRST_OVERRIDABLE_MEMBER_OFFSET) >= VirtualCount)))
+		return dynamic_class_error::VIRTUAL_INDEX_OUT_OF_RANGE;
+	index = entry - FIRST_OVERRIDABLE_MEMBER_OFFSET;
+	return std::error_code();
+}
+
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <typename R, typename... T>
+std::error_code dynamic_derived_class<Base, Extra, VirtualCount>::try_resolve_member_function(
+		R (Base::*slot)(T...) const,
+		std::size_t &index) noexcept
+{
+	member_function_pointer_pun_t<decltype(slot)> thunk;
+	thunk.ptr = slot;
+	std::size_t entry;
+	std::error_code const err = try_resolve_virtual_member_slot(thunk.equiv, sizeof(slot), entry);
+	if (err)
+		return err;
+	if ((entry < FIRST_OVERRIDABLE_MEMBER_OFFSET) || (!DYNAMIC_VIRTUAL_COUNT && ((entry - FIRST_OVERRIDABLE_MEMBER_OFFSET) >= VirtualCount)))
+		return dynamic_class_error::VIRTUAL_INDEX_OUT_OF_RANGE;
+	index = entry - FIRST_OVERRIDABLE_MEMBER_OFFSET;
+	return std::error_code();
+}
+
+
+/// \brief Add a base class with a secondary virtual table
+///
+/// Allows overriding virtual member functions of a base class of the
+/// base class that does not share the primary virtual table pointer,
+/// for example the second of two polymorphic direct base classes.
+/// Instances of the dynamic derived class use a generated secondary
+/// virtual table with the correct offset to top and type info, so
+/// virtual member function calls, type identification, dynamic casts
+/// and deletion work through pointers to the secondary base class.
+/// Must be called for each base class with a secondary virtual table
+/// before the base class virtual table is captured.
+///
+/// Only supported for the Itanium C++ ABI.  Not supported for layered
+/// dynamic derived classes.
+/// \tparam Mixin The base class with a secondary virtual table.  Must
+///   be a non-virtual base class of the base class.
+/// \param [in] virtual_count The total number of virtual member
+///   functions of the secondary base class, excluding the virtual
+///   destructor if present.  This must be correct, and cannot be
+///   checked automatically.
+/// \exception std::invalid_argument Thrown if the secondary base class
+///   shares the primary virtual table pointer or has already been
+///   added, or if this is a layered dynamic derived class.
+/// \exception std::runtime_error Thrown if the base class virtual table
+///   has already been captured.
+/// \sa override_member_function restore_base_member_function
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <class Mixin>
+void dynamic_derived_class<Base, Extra, VirtualCount>::add_secondary_base(
+		std::size_t virtual_count)
+{
+	static_assert((MAME_ABI_CXX_TYPE != MAME_ABI_CXX_MSVC) && sizeof(Mixin), "Secondary base classes are not supported for the MSVC C++ ABI");
+	static_assert(std::is_base_of_v<Mixin, Base>, "Secondary base class must be a base class of the base class");
+	static_assert(std::is_polymorphic_v<Mixin>, "Secondary base class must be polymorphic");
+
+	constexpr std::size_t first_overridable = std::has_virtual_destructor_v<Mixin> ? VTABLE_DESTRUCTOR_ENTRIES : 0;
+	secondary_vtable &secondary = add_secondary_vtable(secondary_base_offset<Base, Mixin>(), first_overridable, virtual_count);
+	if constexpr (std::has_virtual_destructor_v<Mixin>)
 	{
-		std::copy_n(
-				reinterpret_cast<std::uintptr_t const *>(m_base_vtable) + (index * MEMBER_FUNCTION_SIZE),
-				MEMBER_FUNCTION_SIZE,
-				&m_vtable[VTABLE_PREFIX_ENTRIES + (index * MEMBER_FUNCTION_SIZE)]);
+		if (MAME_ABI_CXX_VTABLE_FNDESC)
+		{
+			std::copy_n(
+					reinterpret_cast<std::uintptr_t const *>(std::uintptr_t(&destroyer<Base, Extra>::secondary_complete_object_destructor)),
+					MEMBER_FUNCTION_SIZE,
+					&secondary.vtable[VTABLE_PREFIX_ENTRIES]);
+			std::copy_n(
+					reinterpret_cast<std::uintptr_t const *>(std::uintptr_t(&destroyer<Base, Extra>::secondary_deleting_destructor)),
+					MEMBER_FUNCTION_SIZE,
+					&secondary.vtable[VTABLE_PREFIX_ENTRIES + MEMBER_FUNCTION_SIZE]);
+		}
+		else
+		{
+			secondary.vtable[VTABLE_PREFIX_ENTRIES] = std::uintptr_t(&destroyer<Base, Extra>::secondary_complete_object_destructor);
+			secondary.vtable[VTABLE_PREFIX_ENTRIES + 1] = std::uintptr_t(&destroyer<Base, Extra>::secondary_deleting_destructor);
+		}
+	}
+}
+
+
+/// \brief Override a virtual member function of a secondary base class
+///
+/// Replace the virtual table entry for the specified member function of
+/// a base class of the base class.  If the member function's class
+/// shares the primary virtual table, this is equivalent to overriding a
+/// base class member function.  Otherwise, its secondary base class
+/// must have been added using \c add_secondary_base.  The function is
+/// supplied as a template argument so a thunk can be generated to
+/// adjust the \c this pointer from the secondary base class subobject
+/// to the instance.
+///
+/// Secondary base classes are only supported for the Itanium C++ ABI.
+/// \tparam Func A pointer to the function to use to override the member
+///   function.  Must accept a reference to the value type followed by
+///   the member function's parameters.
+/// \tparam Mixin The class the member function belongs to (usually
+///   determined automatically).
+/// \tparam R Return type of member function to override (usually
+///   determined automatically).
+/// \tparam T Parameter types expected by the member function to
+///   override (usually determined automatically).
+/// \param [in] slot A pointer to the member function to override.  Must
+///   be a pointer to a virtual member function.
+/// \exception std::invalid_argument Thrown if the \p slot argument is
+///   not a supported virtual member function, its virtual table index
+///   is out of range, or its secondary base class has not been added.
+/// \sa add_secondary_base restore_base_member_function
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <auto Func, class Mixin, typename R, typename... T>
+void dynamic_derived_class<Base, Extra, VirtualCount>::override_member_function(
+		R (Mixin::*slot)(T...))
+{
+	static_assert(std::is_same_v<decltype(Func), R MAME_ABI_CXX_MEMBER_CALL (*)(type &, T...)>, "Function type does not match member function");
+	static_assert(std::is_base_of_v<Mixin, Base>, "Member function must belong to a base class of the base class");
+	std::ptrdiff_t const offset = secondary_base_offset<Base, Mixin>();
+	if (!offset)
+	{
+		override_member_function(static_cast<R (Base::*)(T...)>(slot), Func);
+	}
+	else
+	{
+		static_assert(supported_return_type<R>::value, "Unsupported member function return type");
+		member_function_pointer_pun_t<decltype(slot)> thunk;
+		thunk.ptr = slot;
+		auto const func = &secondary_thunk<Func, R, T...>;
+		std::error_code const err = override_secondary_member_slot(offset, thunk.equiv, std::uintptr_t(func), sizeof(func));
+		if (err)
+			throw_error(err);
+	}
+}
+
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <auto Func, class Mixin, typename R, typename... T>
+void dynamic_derived_class<Base, Extra, VirtualCount>::override_member_function(
+		R (Mixin::*slot)(T...) const)
+{
+	static_assert(std::is_same_v<decltype(Func), R MAME_ABI_CXX_MEMBER_CALL (*)(type const &, T...)>, "Function type does not match member function");
+	static_assert(std::is_base_of_v<Mixin, Base>, "Member function must belong to a base class of the base class");
+	std::ptrdiff_t const offset = secondary_base_offset<Base, Mixin>();
+	if (!offset)
+	{
+		override_member_function(static_cast<R (Base::*)(T...) const>(slot), Func);
+	}
+	else
+	{
+		static_assert(supported_return_type<R>::value, "Unsupported member function return type");
+		member_function_pointer_pun_t<decltype(slot)> thunk;
+		thunk.ptr = slot;
+		auto const func = &secondary_const_thunk<Func, R, T...>;
+		std::error_code const err = override_secondary_member_slot(offset, thunk.equiv, std::uintptr_t(func), sizeof(func));
+		if (err)
+			throw_error(err);
+	}
+}
+
+
+/// \brief Restore the base implementation of a secondary base class
+///   member function
+///
+/// If the specified virtual member function of a base class of the base
+/// class has been overridden, restore the base class implementation.
+/// If the member function's class shares the primary virtual table,
+/// this is equivalent to restoring a base class member function.
+/// Otherwise, its secondary base class must have been added using
+/// \c add_secondary_base.
+/// \tparam Mixin The class the member function belongs to (usually
+///   determined automatically).
+/// \tparam R Return type of member function to restore (usually
+///   determined automatically).
+/// \tparam T Parameter types expected by the member function to
+///   to restore (usually determined automatically).
+/// \param [in] slot A pointer to the member function to restore.  Must
+///   be a pointer to a virtual member function.
+/// \exception std::invalid_argument Thrown if the \p slot argument is
+///   not a supported virtual member function, its virtual table index
+///   is out of range, or its secondary base class has not been added.
+/// \sa add_secondary_base override_member_function
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <class Mixin, typename R, typename... T>
+void dynamic_derived_class<Base, Extra, VirtualCount>::restore_base_member_function(
+		R (Mixin::*slot)(T...))
+{
+	static_assert(std::is_base_of_v<Mixin, Base>, "Member function must belong to a base class of the base class");
+	std::ptrdiff_t const offset = secondary_base_offset<Base, Mixin>();
+	if (!offset)
+	{
+		restore_base_member_function(static_cast<R (Base::*)(T...)>(slot));
+	}
+	else
+	{
+		member_function_pointer_pun_t<decltype(slot)> thunk;
+		thunk.ptr = slot;
+		std::error_code const err = restore_secondary_member_slot(offset, thunk.equiv, sizeof(slot));
+		if (err)
+			throw_error(err);
 	}
-	m_overridden[index - FIRST_OVERRIDABLE_MEMBER_OFFSET] = false;
 }
 
 
 /// \brief Create a new instance
 ///
 /// Creates a new instance of the dynamic derived class constructed with
-/// the supplied arguments.
+/// the supplied arguments.  May be called concurrently from multiple
+/// threads.  If the base class virtual table was not captured when the
+/// class was constructed (from an exemplar, or from a prototype or
+/// parent class that had captured it), it is captured from the first
+/// instance created.  Classes that captured it during construction only
+/// test a flag set by the constructor, avoiding the atomic load of the
+/// saved base class virtual table pointer.  Use \c instantiate_captured
+/// to omit the test as well.  For the tracked instance layout, the
+/// class's list of instances is locked while the instance is added, so
+/// concurrent calls for the same class are serialised at that point.
 /// \tparam T Constructor argument types (usually determined
 ///   automatically).
 /// \param [out] object Receives an pointer to the object storing the
@@ -440,66 +1468,709 @@ typename dynamic_derived_class<Base, Extra, VirtualCount>::pointer dynamic_deriv
 		type *&object,
 		T &&... args)
 {
-	std::unique_ptr<type> result(new type(std::forward<T>(args)...));
+	return create_instance<false>(object, std::forward<T>(args)...);
+}
+
+
+/// \brief Create a new instance of a captured class
+///
+/// Creates a new instance of the dynamic derived class in the same way
+/// as \c instantiate, without checking whether the base class virtual
+/// table has been captured.  May only be used if the base class virtual
+/// table was captured when the class was constructed (from an exemplar,
+/// or from a prototype or parent class that had captured it), or when a
+/// previous instance was created.  May be called concurrently from
+/// multiple threads.
+/// \tparam T Constructor argument types (usually determined
+///   automatically).
+/// \param [out] object Receives an pointer to the object storing the
+///   base type and extra data.
+/// \param [in] args Constructor arguments for the object to be
+///   instantiated, as for \c instantiate.
+/// \return A unique pointer to the new instance.
+/// \sa instantiate
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <typename... T>
+typename dynamic_derived_class<Base, Extra, VirtualCount>::pointer dynamic_derived_class<Base, Extra, VirtualCount>::instantiate_captured(
+		type *&object,
+		T &&... args)
+{
+	return create_instance<true>(object, std::forward<T>(args)...);
+}
+
+
+/// \brief Create a new instance
+///
+/// Does the actual work of creating an instance.  Allows callers that
+/// know the base class virtual table has been captured to omit the
+/// check entirely.
+/// \tparam Captured True if the base class virtual table is known to
+///   have been captured already, or false to capture it if necessary.
+/// \tparam T Constructor argument types (usually determined
+///   automatically).
+/// \param [out] object Receives an pointer to the object storing the
+///   base type and extra data.
+/// \param [in] args Constructor arguments for the object to be
+///   instantiated.
+/// \return A unique pointer to the new instance.
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <bool Captured, typename... T>
+typename dynamic_derived_class<Base, Extra, VirtualCount>::pointer dynamic_derived_class<Base, Extra, VirtualCount>::create_instance(
+		type *&object,
+		T &&... args)
+{
+	feature_state *const state = features();
+	if constexpr (column_layout<Extra>::value)
+		extra_columns().reserve();
+	std::unique_ptr<type, void (*)(type *)> result(
+			instance_storage<Base, Extra>::create(std::forward<T>(args)...),
+			&instance_storage<Base, Extra>::destroy);
+	assert(std::uintptr_t(result.get()) == std::uintptr_t(&result->base));
 	auto &vptr = *reinterpret_cast<std::uintptr_t const **>(&result->base);
-	if (!m_base_vtable)
+	if constexpr (!Captured)
 	{
-		assert(std::uintptr_t(result.get()) == std::uintptr_t(&result->base));
-		m_base_vtable = vptr;
-		if (MAME_ABI_CXX_TYPE == MAME_ABI_CXX_MSVC)
-			m_vtable[1] = vptr[-1]; // use the base class complete object locator - too hard to fake
-		for (std::size_t i = 0; VirtualCount > i; ++i)
-		{
-			if (!m_overridden[i])
-			{
-				std::size_t const offset = (i + FIRST_OVERRIDABLE_MEMBER_OFFSET) * MEMBER_FUNCTION_SIZE;
-				std::copy_n(vptr + offset, MEMBER_FUNCTION_SIZE, &m_vtable[VTABLE_PREFIX_ENTRIES + offset]);
-			}
-		}
+		if (!m_base_vtable_ready && !m_root_vtable.load(std::memory_order_acquire))
+			capture_base_vtable(&result->base);
+	}
+	assert(m_root_vtable.load(std::memory_order_relaxed));
+	if (!state)
+	{
+		vptr = instance_vptr();
+	}
+	else
+	{
+		vptr = state->replica_count ? replica_vptr() : instance_vptr();
+		if (!state->secondary.empty())
+			set_secondary_vptrs(&result->base);
+		if constexpr (is_tracked<Extra>::value)
+			link_instance(result->link);
+		if constexpr (column_layout<Extra>::value)
+			extra_columns().attach(result->row);
+		add_instance_reference(&result->base);
+		count_instance_created();
 	}
-	vptr = &m_vtable[VTABLE_PREFIX_ENTRIES];
 	object = result.get();
 	return pointer(&result.release()->base);
 }
 
 
-/// \brief Replace member function in virtual table
+/// \brief Call base class implementation of a member function
 ///
-/// Does the actual work involved in replacing a virtual table entry to
-/// override a virtual member function of the base class, avoiding
-/// duplication between overloads.
-/// \param [in] slot Internal representation of pointer to a virtual
-///   member function of the base class.  May be modified.
-/// \param [in] func A pointer to the function to use to override the
-///   base class member function reinterpreted as an unsigned integer of
-///   equivalent size.
-/// \param [in] size Size of the member function pointer type for the
-///   \p slot argument.
+/// Calls the base class implementation of a virtual member function
+/// for this dynamic derived class.  For a class layered on another
+/// dynamic derived class, this calls the parent class implementation.
+/// Unlike the member function of the instance, this resolves the
+/// implementation relative to this class rather than the class of the
+/// instance, so it must be used by member functions overridden in a
+/// class used as a parent.
+/// \tparam R Return type of member function (usually determined
+///   automatically).
+/// \tparam T Parameter types expected by the member function (usually
+///   determined automatically).
+/// \param [in] object The instance to call the member function for.
+///   May be an instance of this class or a class layered on it.
+/// \param [in] func Pointer to the base class member function to call.
+/// \param [in] args Arguments to pass to the member function.
+/// \return The value returned by the member function.
+/// \exception std::invalid_argument Thrown if the \p func argument is
+///   not a supported member function.
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <typename R, typename... T>
+inline R dynamic_derived_class<Base, Extra, VirtualCount>::call_base_member_function(
+		type &object,
+		R (Base::*func)(T...),
+		T... args) const
+{
+	auto const resolved = resolve_base_member_function(
+			reinterpret_cast<std::uintptr_t const *>(m_base_vtable.load(std::memory_order_relaxed)),
+			object.base,
+			func);
+	return resolved.first(resolved.second, std::forward<T>(args)...);
+}
+
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <typename R, typename... T>
+inline R dynamic_derived_class<Base, Extra, VirtualCount>::call_base_member_function(
+		type const &object,
+		R (Base::*func)(T...) const,
+		T... args) const
+{
+	auto const resolved = resolve_base_member_function(
+			reinterpret_cast<std::uintptr_t const *>(m_base_vtable.load(std::memory_order_relaxed)),
+			object.base,
+			func);
+	return resolved.first(resolved.second, std::forward<T>(args)...);
+}
+
+
+/// \brief Get dynamic derived class for instance
+///
+/// Gets the dynamic derived class an instance belongs to.  The object
+/// must be an instance of a dynamic derived class of this type.  Use
+/// \c is_instance to test whether an object is an instance of a
+/// particular dynamic derived class.
+/// \param [in] object Reference to the base class member of an
+///   instance.
+/// \return A reference to the dynamic derived class of the instance.
+/// \sa is_instance
+template <class Base, typename Extra, std::size_t VirtualCount>
+dynamic_derived_class<Base, Extra, VirtualCount> &dynamic_derived_class<Base, Extra, VirtualCount>::from_instance(
+		Base const &object)
+{
+	return static_cast<dynamic_derived_class &>(get_class(object));
+}
+
+
+/// \brief Get number of live instances
+///
+/// Gets the number of instances of the dynamic derived class that have
+/// been created and not yet destroyed.  Only available if the tracked
+/// instance layout is used.
+/// \return The number of live instances.
+template <class Base, typename Extra, std::size_t VirtualCount>
+std::size_t dynamic_derived_class<Base, Extra, VirtualCount>::instance_count() const
+{
+	static_assert(is_tracked<Extra>::value, "Instance tracking requires the tracked instance layout");
+	feature_state &state = *features();
+	std::lock_guard<std::mutex> guard(state.instances_mutex);
+	return state.instance_count;
+}
+
+
+/// \brief Enumerate live instances
+///
+/// Calls a function for each instance of the dynamic derived class
+/// that has been created and not yet destroyed, in order of creation.
+/// The list of instances is locked while enumerating, so the function
+/// must not create or destroy instances of this class or move
+/// instances to another class.  Only available if the tracked instance
+/// layout is used.
+/// \tparam Func Type of function to call (usually determined
+///   automatically).
+/// \param [in] func Function to call.  Will be passed a reference to
+///   each instance.
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <typename Func>
+void dynamic_derived_class<Base, Extra, VirtualCount>::for_each_instance(Func &&func)
+{
+	static_assert(is_tracked<Extra>::value, "Instance tracking requires the tracked instance layout");
+	feature_state &state = *features();
+	std::lock_guard<std::mutex> guard(state.instances_mutex);
+	for (instance_link *link = state.instances.next; &state.instances != link; )
+	{
+		instance_link *const next = link->next;
+		func(*reinterpret_cast<type *>(reinterpret_cast<std::uint8_t *>(link) - type::link_offset()));
+		link = next;
+	}
+}
+
+
+/// \brief Move all instances to another class
+///
+/// Changes the class of all live instances of the dynamic derived
+/// class to another dynamic derived class with the same base class and
+/// extra data type.  Member functions overridden in the target class
+/// will be called for the instances after they are moved.  The target
+/// class must have the same secondary base classes.  Instances must
+/// not be in use by other threads while they are being moved.  Only
+/// available if the tracked instance layout is used.
+/// \tparam TargetVirtualCount Virtual member function count of the
+///   target class (usually determined automatically).
+/// \param [in] target The dynamic derived class to move instances to.
+/// \return The number of instances moved.
+/// \exception std::invalid_argument Thrown if the target class has
+///   different secondary base classes.
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <std::size_t TargetVirtualCount>
+std::size_t dynamic_derived_class<Base, Extra, VirtualCount>::retarget_instances(
+		dynamic_derived_class<Base, Extra, TargetVirtualCount> &target)
+{
+	static_assert(is_tracked<Extra>::value, "Instance tracking requires the tracked instance layout");
+	return detail::dynamic_derived_class_base::retarget_instances(
+			static_cast<detail::dynamic_derived_class_base &>(target),
+			type::link_offset());
+}
+
+
+/// \brief Get number of extra data rows
+///
+/// Gets the number of rows in the extra data columns, which is equal
+/// to the number of live instances.  Only available if the column
+/// instance layout is used.
+/// \return The number of rows in each column.
+template <class Base, typename Extra, std::size_t VirtualCount>
+inline std::size_t dynamic_derived_class<Base, Extra, VirtualCount>::row_count() const
+{
+	static_assert(column_layout<Extra>::value, "Extra data columns require the column instance layout");
+	return extra_columns().size();
+}
+
+
+/// \brief Get extra data column
+///
+/// Gets a pointer to the contiguous elements of an extra data column,
+/// one for each live instance, suitable for batch processing.  The
+/// pointer is invalidated if any instance of the class is created or
+/// destroyed.  Only available if the column instance layout is used.
+/// \tparam N Zero-based column number.
+/// \return Pointer to the first element of the column.  The number of
+///   elements is returned by \c row_count.
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <std::size_t N>
+inline std::tuple_element_t<N, typename detail::dynamic_derived_class_base::column_layout<Extra>::types> *dynamic_derived_class<Base, Extra, VirtualCount>::column()
+{
+	static_assert(column_layout<Extra>::value, "Extra data columns require the column instance layout");
+	return extra_columns().template data<N>();
+}
+
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <std::size_t N>
+inline std::tuple_element_t<N, typename detail::dynamic_derived_class_base::column_layout<Extra>::types> const *dynamic_derived_class<Base, Extra, VirtualCount>::column() const
+{
+	static_assert(column_layout<Extra>::value, "Extra data columns require the column instance layout");
+	return extra_columns().template data<N>();
+}
+
+
+/// \brief Get instance owning a row
+///
+/// Gets the instance whose extra data is stored in a row of the
+/// columns, for example after finding rows of interest with a batch
+/// operation.  Only available if the column instance layout is used.
+/// \param [in] row Zero-based row number.  Must be less than the value
+///   returned by \c row_count.
+/// \return A reference to the instance.
+template <class Base, typename Extra, std::size_t VirtualCount>
+inline typename dynamic_derived_class<Base, Extra, VirtualCount>::type &dynamic_derived_class<Base, Extra, VirtualCount>::instance_at(
+		std::size_t row)
+{
+	static_assert(column_layout<Extra>::value, "Extra data columns require the column instance layout");
+	auto const &columns = extra_columns();
+	assert(columns.size() > row);
+	return *reinterpret_cast<type *>(reinterpret_cast<std::uint8_t *>(columns.owner(row)) - type::row_offset());
+}
+
+
+/// \brief Set instance reference counting mode
+///
+/// Selects how instances of the dynamic derived class hold references
+/// to it.  Must be called before any instances are created.  The
+/// single-thread mode uses a plain counter, and may only be used if
+/// all instances are created and destroyed by the same thread.  The
+/// sharded mode spreads atomic counters across cache lines selected by
+/// instance address, so threads creating and destroying instances
+/// concurrently rarely contend on the same counter.
+/// \param [in] mode The reference counting mode.
+/// \exception std::bad_alloc Thrown if allocating memory for the
+///   reference count shards fails.
+template <class Base, typename Extra, std::size_t VirtualCount>
+void dynamic_derived_class<Base, Extra, VirtualCount>::set_reference_mode(dynamic_reference_mode mode)
+{
+	detail::dynamic_derived_class_base::set_reference_mode(mode);
+}
+
+
+/// \brief Get reference count
+///
+/// Gets the number of references to the dynamic derived class held by
+/// instances, plus one if the owner has not released the class.  If
+/// instances are being created or destroyed concurrently, the result
+/// is approximate.
+/// \return The number of references to the dynamic derived class, or
+///   zero if reference counting is not enabled.
+template <class Base, typename Extra, std::size_t VirtualCount>
+std::size_t dynamic_derived_class<Base, Extra, VirtualCount>::reference_count() const
+{
+	return detail::dynamic_derived_class_base::reference_count();
+}
+
+
+/// \brief Set number of virtual table replicas
+///
+/// Gives each replica group its own copy of the virtual table.  New
+/// instances use the copy for the replica group of the thread that
+/// creates them, selected using \c current_dynamic_replica_group.
+/// Overriding or restoring member functions only changes the class's
+/// virtual table and advances its epoch, so threads calling member
+/// functions through a copy do not have cache lines invalidated until
+/// the copy is refreshed.  Copies are refreshed when an instance is
+/// created and when \c refresh_replica is called.  Only the primary
+/// virtual table is replicated.  Instances moved to this class using
+/// \c retarget_instances use the class's virtual table.
+///
+/// Until a copy is refreshed, instances using it continue to call the
+/// functions that were in place when it was last refreshed.  Before
+/// code that may still be referenced by a copy is unloaded, call
+/// \c refresh_replicas and wait for threads calling member functions
+/// to leave it.  The override loader does this automatically.
+///
+/// Pass the value returned by \c dynamic_replica_group_count to use one
+/// copy per NUMA node.  A count of zero or one disables replicas, so
+/// instances use the class's virtual table directly, changes are
+/// visible immediately, and there is no additional overhead.  The
+/// count can't be changed once an instance has been created using the
+/// replicas, and must not be changed while instances are being created.
+/// \param [in] count The number of virtual table replicas.
+/// \exception std::runtime_error Thrown if an instance has been created
+///   using the existing replicas.
+/// \exception std::bad_alloc Thrown if allocating memory for the
+///   replicas fails.
+/// \sa refresh_replica refresh_replicas
+template <class Base, typename Extra, std::size_t VirtualCount>
+void dynamic_derived_class<Base, Extra, VirtualCount>::set_replica_count(std::size_t count)
+{
+	std::error_code const err = detail::dynamic_derived_class_base::set_replica_count(count);
+	if (err)
+		throw_error(err);
+}
+
+
+/// \brief Get number of virtual table replicas
+///
+/// Gets the number of virtual table replicas used by the dynamic
+/// derived class.
+/// \return The number of virtual table replicas, or zero if replicas
+///   are not enabled.
+template <class Base, typename Extra, std::size_t VirtualCount>
+std::size_t dynamic_derived_class<Base, Extra, VirtualCount>::replica_count() const
+{
+	feature_state const *const state = features();
+	return state ? state->replica_count : 0;
+}
+
+
+/// \brief Refresh virtual table replica for calling thread
+///
+/// Brings the virtual table replica for the calling thread's replica
+/// group up to date with changes to overridden member functions.
+/// Intended to be called periodically by threads calling member
+/// functions, at points where picking up changes is acceptable.  If
+/// the replica is already up to date, this only compares two epoch
+/// counters.  Has no effect if virtual table replicas are not enabled.
+/// \sa set_replica_count
+template <class Base, typename Extra, std::size_t VirtualCount>
+void dynamic_derived_class<Base, Extra, VirtualCount>::refresh_replica()
+{
+	detail::dynamic_derived_class_base::refresh_replica();
+}
+
+
+/// \brief Refresh all virtual table replicas
+///
+/// Brings the virtual table replicas for all replica groups up to date
+/// with changes to overridden member functions.  Once this returns, no
+/// replica refers to functions that were replaced before it was called,
+/// although threads may still be executing them.  Use before unloading
+/// code that replaced functions may be in.  Has no effect if virtual
+/// table replicas are not enabled.
+/// \sa set_replica_count refresh_replica
+template <class Base, typename Extra, std::size_t VirtualCount>
+void dynamic_derived_class<Base, Extra, VirtualCount>::refresh_replicas()
+{
+	detail::dynamic_derived_class_base::refresh_replicas();
+}
+
+
+/// \brief Get statistics
+///
+/// Gets statistics for the dynamic derived class.  Counters are only
+/// maintained if \c MAME_DYNAMIC_CLASS_STATS is non-zero.  Counters
+/// that are only meaningful in aggregate are zero.
+/// \return Statistics for the dynamic derived class.
+template <class Base, typename Extra, std::size_t VirtualCount>
+dynamic_derived_class_stats dynamic_derived_class<Base, Extra, VirtualCount>::stats() const
+{
+	dynamic_derived_class_stats result;
+	collect_stats(result);
+	return result;
+}
+
+
+/// \brief Pass ownership of a class to its instances
+///
+/// Releases the owner's reference to a dynamic derived class.  The
+/// class is destroyed when its last instance is destroyed, or
+/// immediately if it has no instances.  The class must not be used
+/// after it has been released, except through its instances.
+/// \param [in,out] cls The dynamic derived class to release.  Ownership
+///   is taken if the function returns normally.
+/// \exception std::invalid_argument Thrown if reference counting is not
+///   enabled for the class.
+template <class Base, typename Extra, std::size_t VirtualCount>
+void dynamic_derived_class<Base, Extra, VirtualCount>::release(std::unique_ptr<dynamic_derived_class> &&cls)
+{
+	assert(cls);
+	cls->release_owner_reference(
+			[] (detail::dynamic_derived_class_base &obj) { delete static_cast<dynamic_derived_class *>(&obj); });
+	cls.release();
+}
+
+
+/// \brief Call a virtual member function for multiple objects
+///
+/// Calls a virtual member function for each object in a range, in
+/// order.  The objects may be instances of any number of dynamic
+/// derived classes with the same base class, or instances of the base
+/// class itself.  The implementation of the member function is resolved
+/// once for each run of consecutive objects sharing a virtual table.
+/// The range is not modified.  Use \c sort_by_class to group objects of
+/// the same class together once, rather than on every call.  Return
+/// values are discarded.
+/// \tparam R Return type of member function (usually determined
+///   automatically).
+/// \tparam T Parameter types expected by the member function (usually
+///   determined automatically).
+/// \param [in] first Pointer to the first object pointer in the range.
+/// \param [in] last Pointer past the last object pointer in the range.
+/// \param [in] slot A pointer to the base class member function to
+///   call.  Must be a pointer to a virtual member function.
+/// \param [in] args Arguments to pass to the member function for each
+///   object.  Arguments are passed as lvalues, and are not moved.
 /// \exception std::invalid_argument Thrown if the \p slot argument is
 ///   not a supported virtual member function.
+/// \sa sort_by_class
 template <class Base, typename Extra, std::size_t VirtualCount>
-void dynamic_derived_class<Base, Extra, VirtualCount>::override_member_function(
-		member_function_pointer_equiv &slot,
-		std::uintptr_t func,
-		std::size_t size)
-{
-	std::size_t const index = resolve_virtual_member_slot(slot, size);
-	assert(index < VIRTUAL_MEMBER_FUNCTION_COUNT);
-	assert(FIRST_OVERRIDABLE_MEMBER_OFFSET <= index);
-	m_overridden[index - FIRST_OVERRIDABLE_MEMBER_OFFSET] = true;
-	if (MAME_ABI_CXX_VTABLE_FNDESC)
+template <typename R, typename... T>
+void dynamic_derived_class<Base, Extra, VirtualCount>::invoke_member_function(
+		Base *const *first,
+		Base *const *last,
+		R (Base::*slot)(T...),
+		T... args)
+{
+	static_assert(supported_return_type<R>::value, "Unsupported member function return type");
+	member_function_pointer_pun_t<decltype(slot)> thunk;
+	thunk.ptr = slot;
+	std::size_t const index = resolve_virtual_member_slot(thunk.equiv, sizeof(slot));
+	invoke_virtual_member_function<Base, R, T...>(first, last, index, args...);
+}
+
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <typename R, typename... T>
+void dynamic_derived_class<Base, Extra, VirtualCount>::invoke_member_function(
+		Base const *const *first,
+		Base const *const *last,
+		R (Base::*slot)(T...) const,
+		T... args)
+{
+	static_assert(supported_return_type<R>::value, "Unsupported member function return type");
+	member_function_pointer_pun_t<decltype(slot)> thunk;
+	thunk.ptr = slot;
+	std::size_t const index = resolve_virtual_member_slot(thunk.equiv, sizeof(slot));
+	invoke_virtual_member_function<Base const, R, T...>(first, last, index, args...);
+}
+
+
+/// \brief Group objects by class
+///
+/// Reorders a range of object pointers so that objects of the same
+/// class are contiguous, allowing \c invoke_member_function to resolve
+/// the member function once per class.  The relative order of objects
+/// of the same class is preserved.  Intended to be called when the
+/// range changes, rather than before every batch call.
+/// \param [in,out] first Pointer to the first object pointer in the
+///   range.
+/// \param [in,out] last Pointer past the last object pointer in the
+///   range.
+/// \sa invoke_member_function
+template <class Base, typename Extra, std::size_t VirtualCount>
+void dynamic_derived_class<Base, Extra, VirtualCount>::sort_by_class(
+		Base **first,
+		Base **last)
+{
+	sort_by_vptr(first, last);
+}
+
+template <class Base, typename Extra, std::size_t VirtualCount>
+void dynamic_derived_class<Base, Extra, VirtualCount>::sort_by_class(
+		Base const **first,
+		Base const **last)
+{
+	sort_by_vptr(first, last);
+}
+
+
+/// \brief Secondary virtual table thunk
+///
+/// Adjusts the \c this pointer from a secondary base class subobject to
+/// the instance and calls the function overriding a member function of
+/// the secondary base class.
+/// \tparam Func The function overriding the member function.
+/// \tparam R Return type of the member function.
+/// \tparam T Parameter types expected by the member function.
+/// \param [in] object Pointer to the secondary base class subobject.
+/// \param [in] args Arguments to pass to the function.
+/// \return The value returned by the function.
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <auto Func, typename R, typename... T>
+R MAME_ABI_CXX_MEMBER_CALL dynamic_derived_class<Base, Extra, VirtualCount>::secondary_thunk(
+		void *object,
+		T... args)
+{
+	return Func(*reinterpret_cast<type *>(complete_object(object)), std::forward<T>(args)...);
+}
+
+template <class Base, typename Extra, std::size_t VirtualCount>
+template <auto Func, typename R, typename... T>
+R MAME_ABI_CXX_MEMBER_CALL dynamic_derived_class<Base, Extra, VirtualCount>::secondary_const_thunk(
+		void const *object,
+		T... args)
+{
+	return Func(*reinterpret_cast<type const *>(complete_object(const_cast<void *>(object))), std::forward<T>(args)...);
+}
+
+
+/// \brief Allocate virtual table storage
+///
+/// Allocates storage for the virtual table and overridden member
+/// function flags if the virtual member function count is supplied at
+/// run time, and sets up pointers to the storage.  Optional feature
+/// state is allocated up front for the tracked and column instance
+/// layouts, as every instance uses it.
+template <class Base, typename Extra, std::size_t VirtualCount>
+void dynamic_derived_class<Base, Extra, VirtualCount>::allocate_storage()
+{
+	if constexpr (DYNAMIC_VIRTUAL_COUNT)
 	{
-		std::copy_n(
-				reinterpret_cast<std::uintptr_t const *>(func),
-				MEMBER_FUNCTION_SIZE,
-				&m_vtable[VTABLE_PREFIX_ENTRIES + (index * MEMBER_FUNCTION_SIZE)]);
+		m_storage.reset(new std::uintptr_t[storage_size(FIRST_OVERRIDABLE_MEMBER_OFFSET, m_virtual_count)]);
+		set_storage(m_storage.get());
 	}
 	else
 	{
-		m_vtable[VTABLE_PREFIX_ENTRIES + index] = func;
+		set_storage(m_storage.data());
+	}
+	if constexpr (is_tracked<Extra>::value)
+		require_features();
+	if constexpr (column_layout<Extra>::value)
+		require_features().columns = std::make_unique<typename column_layout<Extra>::storage>();
+}
+
+
+/// \brief Set virtual table entries for destructor
+///
+/// Sets the virtual table entries for the virtual destructor if the
+/// base class has a virtual destructor.  The destructors restore the
+/// base class virtual table pointer before destroying the instance.
+template <class Base, typename Extra, std::size_t VirtualCount>
+void dynamic_derived_class<Base, Extra, VirtualCount>::init_destructor_entries()
+{
+	if constexpr (std::has_virtual_destructor_v<Base>)
+	{
+		if (MAME_ABI_CXX_TYPE == MAME_ABI_CXX_MSVC)
+		{
+			if (MAME_ABI_CXX_VTABLE_FNDESC)
+			{
+				std::copy_n(
+						reinterpret_cast<std::uintptr_t const *>(std::uintptr_t(&destroyer<Base, Extra>::scalar_deleting_destructor)),
+						MEMBER_FUNCTION_SIZE,
+						&m_vtable[VTABLE_PREFIX_ENTRIES]);
+			}
+			else
+			{
+				m_vtable[VTABLE_PREFIX_ENTRIES] = std::uintptr_t(&destroyer<Base, Extra>::scalar_deleting_destructor);
+			}
+		}
+		else
+		{
+			if (MAME_ABI_CXX_VTABLE_FNDESC)
+			{
+				std::copy_n(
+						reinterpret_cast<std::uintptr_t const *>(std::uintptr_t(&destroyer<Base, Extra>::complete_object_destructor)),
+						MEMBER_FUNCTION_SIZE,
+						&m_vtable[VTABLE_PREFIX_ENTRIES]);
+				std::copy_n(
+						reinterpret_cast<std::uintptr_t const *>(std::uintptr_t(&destroyer<Base, Extra>::deleting_destructor)),
+						MEMBER_FUNCTION_SIZE,
+						&m_vtable[VTABLE_PREFIX_ENTRIES + MEMBER_FUNCTION_SIZE]);
+			}
+			else
+			{
+				m_vtable[VTABLE_PREFIX_ENTRIES] = std::uintptr_t(&destroyer<Base, Extra>::complete_object_destructor);
+				m_vtable[VTABLE_PREFIX_ENTRIES + 1] = std::uintptr_t(&destroyer<Base, Extra>::deleting_destructor);
+			}
+		}
 	}
 }
 
+
+
+//**************************************************************************
+//  dynamic_derived_class_profile
+//**************************************************************************
+
+/// \brief Save class state
+///
+/// Saves the overridable member function entries and overridden flags
+/// of the specified class in the profile.  If the class has already
+/// been saved in the profile, the saved state is replaced.
+/// \param [in] cls The dynamic derived class to save.
+/// \exception std::bad_alloc Thrown if allocating memory for the saved
+///   state fails.
+template <class Base, typename Extra, std::size_t VirtualCount>
+inline void dynamic_derived_class_profile::save(dynamic_derived_class<Base, Extra, VirtualCount> &cls)
+{
+	save(static_cast<detail::dynamic_derived_class_base &>(cls));
+}
+
+
+/// \brief Apply saved class state
+///
+/// Restores the overridable member function entries and overridden
+/// flags of the specified class from the profile.
+/// \param [in] cls The dynamic derived class to restore.
+/// \exception std::invalid_argument Thrown if the class has not been
+///   saved in the profile.
+template <class Base, typename Extra, std::size_t VirtualCount>
+inline void dynamic_derived_class_profile::apply(dynamic_derived_class<Base, Extra, VirtualCount> &cls) const
+{
+	apply(static_cast<detail::dynamic_derived_class_base &>(cls));
+}
+
+
+/// \brief Remove class from profile
+///
+/// Discards the saved state of the specified class.  Has no effect if
+/// the class has not been saved in the profile.
+/// \param [in] cls The dynamic derived class to remove.
+template <class Base, typename Extra, std::size_t VirtualCount>
+inline void dynamic_derived_class_profile::remove(dynamic_derived_class<Base, Extra, VirtualCount> const &cls)
+{
+	remove(static_cast<detail::dynamic_derived_class_base const &>(cls));
+}
+
+
+
+/// \brief Get dynamic derived class
+///
+/// Gets the dynamic derived class, creating it and applying the
+/// overrides on first use.  If exemplar capture was requested, the base
+/// class virtual table is captured from a temporary instance at the
+/// same time.  Creating the class is thread-safe.
+/// \return A reference to the dynamic derived class.
+/// \exception std::invalid_argument Thrown if the class name is invalid
+///   or unsupported, or an override is not supported, the first time
+///   the class is used.
+template <class Base, typename Extra, std::size_t VirtualCount, class Name, class... Overrides>
+typename static_dynamic_class<Base, Extra, VirtualCount, Name, Overrides...>::class_type &static_dynamic_class<Base, Extra, VirtualCount, Name, Overrides...>::get()
+{
+	static class_type &result = [] () -> class_type &
+			{
+				if constexpr (EXEMPLAR)
+				{
+					Base const exemplar{};
+					static class_type cls(exemplar, Name::value);
+					(Overrides::apply(cls), ...);
+					return cls;
+				}
+				else
+				{
+					static class_type cls(Name::value);
+					(Overrides::apply(cls), ...);
+					return cls;
+				}
+			}();
+	return result;
+}
+
 } // namespace util
 
 #endif // MAME_LIB_UTIL_DYNAMICCLASS_IPP
@@ -0,0 +1,618 @@
+// license:BSD-3-Clause
+// copyright-holders:Vas Crabb
+#include "dynamicmodule.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace util {
+
+namespace {
+
+/// \brief Load a module
+///
+/// Loads a shared object, resolving all symbols immediately.
+/// \param [in] path Path to the shared object, or \c nullptr for the
+///   main program.
+/// \return A handle for the module, or \c nullptr on failure.
+void *open_module(char const *path)
+{
+#if defined(_WIN32)
+	if (!path)
+	{
+		HMODULE handle = nullptr;
+		return GetModuleHandleExA(0, nullptr, &handle) ? reinterpret_cast<void *>(handle) : nullptr;
+	}
+	return reinterpret_cast<void *>(LoadLibraryA(path));
+#else
+	return dlopen(path, RTLD_NOW | RTLD_LOCAL);
+#endif
+}
+
+
+/// \brief Find a symbol in a module
+///
+/// \param [in] handle Handle for the module.
+/// \param [in] symbol Null-terminated symbol name.
+/// \return The address of the symbol, or zero if it is not found.
+std::uintptr_t find_symbol(void *handle, char const *symbol)
+{
+#if defined(_WIN32)
+	return std::uintptr_t(GetProcAddress(reinterpret_cast<HMODULE>(handle), symbol));
+#else
+	return std::uintptr_t(dlsym(handle, symbol));
+#endif
+}
+
+
+/// \brief Unload a module
+///
+/// \param [in] handle Handle for the module.
+void close_module(void *handle)
+{
+#if defined(_WIN32)
+	FreeLibrary(reinterpret_cast<HMODULE>(handle));
+#else
+	dlclose(handle);
+#endif
+}
+
+
+/// \brief Find a symbol in the global scope
+///
+/// Searches the main program and all loaded modules that make their
+/// symbols globally available.
+/// \param [in] symbol Null-terminated symbol name.
+/// \return The address of the symbol, or zero if it is not found.
+std::uintptr_t find_global_symbol(char const *symbol)
+{
+#if defined(_WIN32)
+	return std::uintptr_t(GetProcAddress(GetModuleHandleA(nullptr), symbol));
+#else
+	return std::uintptr_t(dlsym(RTLD_DEFAULT, symbol));
+#endif
+}
+
+
+/// \brief Get error code for last C library error
+///
+/// \return An error code in the generic category for the current value
+///   of \c errno.
+std::error_code last_system_error()
+{
+	return std::error_code(errno, std::generic_category());
+}
+
+} // anonymous namespace
+
+
+
+dynamic_override_loader::dynamic_override_loader() :
+	m_current(nullptr),
+	m_epoch(1)
+{
+}
+
+
+/// \brief Destroy loader
+///
+/// Unloads the current module and all retired modules without
+/// restoring base class implementations.  Classes must not be used
+/// after the loader is destroyed if a module was loaded, unless
+/// \c unload was called.
+dynamic_override_loader::~dynamic_override_loader()
+{
+	assert(m_readers.empty());
+	for (retired_module const &module : m_retired)
+		close_module(module.handle);
+	if (m_current)
+		close_module(m_current);
+}
+
+
+/// \brief Load a module
+///
+/// Loads a shared object and overrides all bound member functions with
+/// the functions it exports.  All symbols are resolved before any
+/// class is modified.  If a module was previously loaded, it is
+/// retired, and unloaded once no reader can be executing its code.
+/// \param [in] path Path to the shared object, or \c nullptr to use
+///   symbols exported by the main program.
+/// \return An error code if the module cannot be loaded or does not
+///   export a bound symbol.  The previously loaded module remains in
+///   use if an error is returned.
+std::error_code dynamic_override_loader::load(char const *path)
+{
+	std::lock_guard<std::mutex> guard(m_mutex);
+
+	void *const handle = open_module(path);
+	if (!handle)
+		return dynamic_class_error::MODULE_NOT_LOADED;
+
+	std::vector<std::uintptr_t> funcs;
+	funcs.reserve(m_bindings.size());
+	for (auto const &bound : m_bindings)
+	{
+		std::uintptr_t const func = find_symbol(handle, bound->symbol().c_str());
+		if (!func)
+		{
+			close_module(handle);
+			return dynamic_class_error::SYMBOL_NOT_FOUND;
+		}
+		funcs.emplace_back(func);
+	}
+
+	for (std::size_t i = 0; m_bindings.size() > i; ++i)
+	{
+		// member functions were checked when bound, so this can't fail
+		[[maybe_unused]] std::error_code const err = m_bindings[i]->apply(funcs[i]);
+		assert(!err);
+	}
+
+	retire_current();
+	m_current = handle;
+	reclaim_retired();
+	return std::error_code();
+}
+
+
+/// \brief Unload the current module
+///
+/// Restores base class implementations of all bound member functions,
+/// and retires the current module.  The module is unloaded once no
+/// reader can be executing its code.  Bindings are retained, so a
+/// module can be loaded again later.
+void dynamic_override_loader::unload()
+{
+	std::lock_guard<std::mutex> guard(m_mutex);
+	if (m_current)
+	{
+		for (auto const &bound : m_bindings)
+			bound->restore();
+		retire_current();
+		reclaim_retired();
+	}
+}
+
+
+/// \brief Unload retired modules
+///
+/// Unloads retired modules that no reader can be executing code from.
+/// Called automatically when a module is loaded or unloaded, but must
+/// be called periodically to unload modules once readers have reported
+/// quiescent states.
+/// \return The number of retired modules that are still waiting to be
+///   unloaded.
+std::size_t dynamic_override_loader::reclaim()
+{
+	std::lock_guard<std::mutex> guard(m_mutex);
+	return reclaim_retired();
+}
+
+
+/// \brief Add a binding
+///
+/// Adds a binding, and applies it immediately if a module is loaded.
+/// The caller must not hold the mutex.
+/// \param [in] bound The binding to add.
+/// \return An error code if a module is loaded and the symbol cannot be
+///   resolved or applied.
+std::error_code dynamic_override_loader::add_binding(std::unique_ptr<binding> &&bound)
+{
+	std::lock_guard<std::mutex> guard(m_mutex);
+	if (m_current)
+	{
+		std::uintptr_t const func = find_symbol(m_current, bound->symbol().c_str());
+		if (!func)
+			return dynamic_class_error::SYMBOL_NOT_FOUND;
+		std::error_code const err = bound->apply(func);
+		if (err)
+			return err;
+	}
+	m_bindings.emplace_back(std::move(bound));
+	return std::error_code();
+}
+
+
+/// \brief Retire the current module
+///
+/// Moves the current module to the list of retired modules and
+/// advances the epoch, so readers that report a quiescent state after
+/// this point are known not to be using the module.  Classes must
+/// already have stopped using the module.  The caller must hold the
+/// mutex.
+void dynamic_override_loader::retire_current()
+{
+	if (m_current)
+	{
+		std::uint64_t const epoch = m_epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+		m_retired.emplace_back(retired_module{ m_current, epoch });
+		m_current = nullptr;
+	}
+}
+
+
+/// \brief Unload retired modules that are no longer in use
+///
+/// The caller must hold the mutex.
+/// \return The number of retired modules that are still waiting to be
+///   unloaded.
+std::size_t dynamic_override_loader::reclaim_retired()
+{
+	std::uint64_t oldest = reader::OFFLINE;
+	for (reader const *r : m_readers)
+		oldest = (std::min)(oldest, r->m_seen.load(std::memory_order_seq_cst));
+
+	auto const keep = std::remove_if(
+			m_retired.begin(),
+			m_retired.end(),
+			[oldest] (retired_module const &module)
+			{
+				if (oldest < module.epoch)
+					return false;
+				close_module(module.handle);
+				return true;
+			});
+	m_retired.erase(keep, m_retired.end());
+	return m_retired.size();
+}
+
+
+
+/// \brief Register reader
+///
+/// Registers the calling thread as a reader.  The reader is online and
+/// has reported a quiescent state in the current epoch.
+/// \param [in] loader The loader to register with.  Must not be
+///   destroyed before the reader.
+dynamic_override_loader::reader::reader(dynamic_override_loader &loader) :
+	m_loader(loader),
+	m_seen(loader.epoch())
+{
+	std::lock_guard<std::mutex> guard(m_loader.m_mutex);
+	m_loader.m_readers.emplace_back(this);
+}
+
+
+/// \brief Unregister reader
+///
+/// The thread must not call overriding functions supplied by modules
+/// after the reader is destroyed.
+dynamic_override_loader::reader::~reader()
+{
+	std::lock_guard<std::mutex> guard(m_loader.m_mutex);
+	m_loader.m_readers.erase(std::find(m_loader.m_readers.begin(), m_loader.m_readers.end(), this));
+}
+
+
+
+dynamic_override_cache::dynamic_override_cache() :
+	m_mapping(nullptr),
+	m_size(0),
+	m_header(nullptr),
+	m_classes(nullptr),
+	m_slots(nullptr),
+	m_strings(nullptr)
+{
+}
+
+
+dynamic_override_cache::~dynamic_override_cache()
+{
+	close();
+}
+
+
+/// \brief Write saved classes to file
+///
+/// Writes all classes saved using \c add to a file, replacing its
+/// contents.  The file uses the byte order of the host.
+/// \param [in] path Path to the file to write.
+/// \return An error code if the file cannot be written.
+/// \exception std::bad_alloc Thrown if allocating memory for the file
+///   contents fails.
+std::error_code dynamic_override_cache::write(char const *path) const
+{
+	std::vector<saved_class const *> sorted;
+	sorted.reserve(m_saved.size());
+	for (saved_class const &cls : m_saved)
+		sorted.emplace_back(&cls);
+	std::sort(
+			sorted.begin(),
+			sorted.end(),
+			[] (saved_class const *a, saved_class const *b) { return a->name < b->name; });
+
+	std::vector<file_class> classes;
+	std::vector<file_slot> slots;
+	std::string strings;
+	classes.reserve(sorted.size());
+	for (saved_class const *cls : sorted)
+	{
+		classes.emplace_back(file_class{ std::uint32_t(strings.size()), std::uint32_t(cls->virtual_count), std::uint32_t(slots.size()), std::uint32_t(cls->slots.size()) });
+		strings.append(cls->name.c_str(), cls->name.length() + 1);
+		for (auto const &slot : cls->slots)
+		{
+			slots.emplace_back(file_slot{ std::uint32_t(slot.first), std::uint32_t(strings.size()) });
+			strings.append(slot.second.c_str(), slot.second.length() + 1);
+		}
+	}
+	file_header const header{ MAGIC, VERSION, std::uint32_t(classes.size()), std::uint32_t(slots.size()), std::uint32_t(strings.size()) };
+
+	std::FILE *const file = std::fopen(path, "wb");
+	if (!file)
+		return last_system_error();
+	bool const ok =
+			(1 == std::fwrite(&header, sizeof(header), 1, file)) &&
+			(classes.size() == std::fwrite(classes.data(), sizeof(file_class), classes.size(), file)) &&
+			(slots.size() == std::fwrite(slots.data(), sizeof(file_slot), slots.size(), file)) &&
+			(strings.size() == std::fwrite(strings.data(), 1, strings.size(), file));
+	std::error_code const err = ok ? std::error_code() : last_system_error();
+	if (std::fclose(file) && ok)
+		return last_system_error();
+	return err;
+}
+
+
+/// \brief Read file
+///
+/// Maps a file written by \c write into memory so saved overrides can
+/// be applied to classes.  Any previously read file is closed.  Classes
+/// saved using \c add are not affected.
+/// \param [in] path Path to the file to read.
+/// \return An error code if the file cannot be read or is not a valid
+///   override cache file.
+std::error_code dynamic_override_cache::read(char const *path)
+{
+	close();
+
+#if defined(_WIN32)
+	std::FILE *const file = std::fopen(path, "rb");
+	if (!file)
+		return last_system_error();
+	std::fseek(file, 0, SEEK_END);
+	long const size = std::ftell(file);
+	std::fseek(file, 0, SEEK_SET);
+	if (0 > size)
+	{
+		std::error_code const err = last_system_error();
+		std::fclose(file);
+		return err;
+	}
+	m_buffer.reset(new (std::nothrow) std::uint8_t [std::size_t(size) + 1]);
+	if (!m_buffer)
+	{
+		std::fclose(file);
+		return std::make_error_code(std::errc::not_enough_memory);
+	}
+	m_size = std::fread(m_buffer.get(), 1, std::size_t(size), file);
+	std::fclose(file);
+	std::uint8_t const *const data = m_buffer.get();
+#else
+	int const fd = ::open(path, O_RDONLY);
+	if (0 > fd)
+		return last_system_error();
+	struct stat st;
+	if (::fstat(fd, &st))
+	{
+		std::error_code const err = last_system_error();
+		::close(fd);
+		return err;
+	}
+	m_size = std::size_t(st.st_size);
+	if (m_size)
+	{
+		m_mapping = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (MAP_FAILED == m_mapping)
+		{
+			std::error_code const err = last_system_error();
+			m_mapping = nullptr;
+			m_size = 0;
+			::close(fd);
+			return err;
+		}
+	}
+	::close(fd);
+	std::uint8_t const *const data = reinterpret_cast<std::uint8_t const *>(m_mapping);
+#endif
+
+	if (sizeof(file_header) <= m_size)
+	{
+		m_header = reinterpret_cast<file_header const *>(data);
+		m_classes = reinterpret_cast<file_class const *>(data + sizeof(file_header));
+		m_slots = reinterpret_cast<file_slot const *>(m_classes + m_header->class_count);
+		m_strings = reinterpret_cast<char const *>(m_slots + m_header->slot_count);
+	}
+	if (!validate())
+	{
+		close();
+		return dynamic_class_error::INVALID_CACHE;
+	}
+	return std::error_code();
+}
+
+
+/// \brief Close file
+///
+/// Unmaps the file that was read, if any.  Classes saved using \c add
+/// are not affected.
+void dynamic_override_cache::close()
+{
+#if !defined(_WIN32)
+	if (m_mapping)
+		::munmap(m_mapping, m_size);
+#endif
+	m_buffer.reset();
+	m_mapping = nullptr;
+	m_size = 0;
+	m_header = nullptr;
+	m_classes = nullptr;
+	m_slots = nullptr;
+	m_strings = nullptr;
+}
+
+
+/// \brief Save class overrides
+///
+/// Does the actual work of recording the overridden member functions of
+/// a class, avoiding template instantiations for each class type.
+/// \param [in] cls The dynamic derived class to save.
+/// \return An error code if an overriding function cannot be named, or
+///   a member function of a secondary base class is overridden.
+/// \exception std::bad_alloc Thrown if allocating memory for the saved
+///   state fails.
+std::error_code dynamic_override_cache::add(detail::dynamic_derived_class_base const &cls)
+{
+#if defined(_WIN32) || MAME_ABI_CXX_VTABLE_FNDESC
+	return dynamic_class_error::UNSUPPORTED_ARCHITECTURE;
+#else
+	// only the primary virtual table is saved
+	auto const *const state = cls.features();
+	if (state)
+	{
+		for (auto const &secondary : state->secondary)
+		{
+			std::uintptr_t const *const overridden = &secondary.vtable[
+					detail::dynamic_derived_class_base::VTABLE_PREFIX_ENTRIES +
+					((secondary.first_overridable + secondary.virtual_count) * detail::dynamic_derived_class_base::MEMBER_FUNCTION_SIZE)];
+			std::size_t const count =
+					(secondary.virtual_count + detail::dynamic_derived_class_base::OVERRIDDEN_FLAGS_PER_ENTRY - 1) /
+					detail::dynamic_derived_class_base::OVERRIDDEN_FLAGS_PER_ENTRY;
+			if (std::any_of(overridden, overridden + count, [] (std::uintptr_t flags) { return 0 != flags; }))
+				return dynamic_class_error::SECONDARY_OVERRIDE;
+		}
+	}
+
+	saved_class saved{ cls.m_name, cls.m_virtual_count, { } };
+	for (std::size_t i = 0; cls.m_virtual_count > i; ++i)
+	{
+		if (cls.is_overridden(i))
+		{
+			std::uintptr_t const func = cls.m_vtable[
+					detail::dynamic_derived_class_base::VTABLE_PREFIX_ENTRIES +
+					((cls.m_first_overridable + i) * detail::dynamic_derived_class_base::MEMBER_FUNCTION_SIZE)];
+			Dl_info info;
+			if (!::dladdr(reinterpret_cast<void *>(func), &info) || !info.dli_sname || (std::uintptr_t(info.dli_saddr) != func))
+				return dynamic_class_error::UNNAMED_OVERRIDE;
+			if (find_global_symbol(info.dli_sname) != func)
+				return dynamic_class_error::UNNAMED_OVERRIDE;
+			saved.slots.emplace_back(i, info.dli_sname);
+		}
+	}
+
+	auto const existing = std::find_if(
+			m_saved.begin(),
+			m_saved.end(),
+			[&cls] (saved_class const &s) { return s.name == cls.m_name; });
+	if (m_saved.end() != existing)
+		*existing = std::move(saved);
+	else
+		m_saved.emplace_back(std::move(saved));
+	return std::error_code();
+#endif
+}
+
+
+/// \brief Find class in file
+///
+/// Finds the record for a class in the file that was read using a
+/// binary search by name.
+/// \param [in] cls The dynamic derived class to look for.
+/// \return Pointer to the class record, or \c nullptr if the class is
+///   not in the file.
+dynamic_override_cache::file_class const *dynamic_override_cache::find(detail::dynamic_derived_class_base const &cls) const
+{
+	if (!m_header)
+		return nullptr;
+	char const *const name = cls.m_name.c_str();
+	file_class const *const end = m_classes + m_header->class_count;
+	file_class const *const found = std::lower_bound(
+			m_classes,
+			end,
+			name,
+			[this] (file_class const &c, char const *n) { return std::strcmp(&m_strings[c.name], n) < 0; });
+	return ((end != found) && !std::strcmp(&m_strings[found->name], name)) ? found : nullptr;
+}
+
+
+/// \brief Apply cached overrides
+///
+/// Does the actual work of overriding member functions of a class,
+/// avoiding template instantiations for each class type.
+/// \param [in] cls The dynamic derived class to modify.
+/// \return An error code if the class is not in the file, its virtual
+///   member function count differs, or an overriding function cannot be
+///   found.
+std::error_code dynamic_override_cache::apply(detail::dynamic_derived_class_base &cls) const
+{
+	file_class const *const found = find(cls);
+	if (!found)
+		return dynamic_class_error::NOT_IN_CACHE;
+	if (found->virtual_count != cls.m_virtual_count)
+		return dynamic_class_error::VIRTUAL_COUNT_MISMATCH;
+
+	file_slot const *const slots = m_slots + found->first_slot;
+	std::unique_ptr<std::uintptr_t []> funcs(new (std::nothrow) std::uintptr_t [found->slot_count]);
+	if (found->slot_count && !funcs)
+		return std::make_error_code(std::errc::not_enough_memory);
+	for (std::uint32_t i = 0; found->slot_count > i; ++i)
+	{
+		funcs[i] = find_global_symbol(&m_strings[slots[i].symbol]);
+		if (!funcs[i])
+			return dynamic_class_error::SYMBOL_NOT_FOUND;
+	}
+	for (std::uint32_t i = 0; found->slot_count > i; ++i)
+		cls.override_virtual_member_entry(cls.m_first_overridable + slots[i].index, funcs[i]);
+	return std::error_code();
+}
+
+
+/// \brief Check file that was read
+///
+/// Checks that the header, record counts and string offsets of the file
+/// that was read are consistent with its size, and that classes are
+/// sorted by name.
+/// \return True if the file is valid, or false otherwise.
+bool dynamic_override_cache::validate() const
+{
+	if (!m_header || (MAGIC != m_header->magic) || (VERSION != m_header->version))
+		return false;
+	std::uint64_t const expected =
+			std::uint64_t(sizeof(file_header)) +
+			(std::uint64_t(m_header->class_count) * sizeof(file_class)) +
+			(std::uint64_t(m_header->slot_count) * sizeof(file_slot)) +
+			m_header->string_size;
+	if ((expected != m_size) || (m_header->string_size && m_strings[m_header->string_size - 1]))
+		return false;
+
+	for (std::uint32_t i = 0; m_header->class_count > i; ++i)
+	{
+		file_class const &cls = m_classes[i];
+		if ((cls.name >= m_header->string_size) || (cls.first_slot > m_header->slot_count) || (cls.slot_count > (m_header->slot_count - cls.first_slot)))
+			return false;
+		if (i && (std::strcmp(&m_strings[m_classes[i - 1].name], &m_strings[cls.name]) >= 0))
+			return false;
+		for (std::uint32_t j = 0; cls.slot_count > j; ++j)
+		{
+			file_slot const &slot = m_slots[cls.first_slot + j];
+			if ((slot.index >= cls.virtual_count) || (slot.symbol >= m_header->string_size))
+				return false;
+		}
+	}
+	return true;
+}
+
+} // namespace util
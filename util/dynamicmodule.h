@@ -0,0 +1,452 @@
+// license:BSD-3-Clause
+// copyright-holders:Vas Crabb
+/// \file
+/// \brief Hot-reloadable override modules for dynamic derived classes
+///
+/// Allows implementations of overriding member functions to be loaded
+/// from a shared object at run time and bound to member functions of
+/// existing dynamic derived classes by symbol name.  A newer build of
+/// the module can be loaded while instances exist, and the previous
+/// module is only unloaded once no thread can still be executing code
+/// from it.
+///
+/// Also provides a persistent cache of overrides identified by symbol
+/// name, allowing overrides to be reapplied quickly when a program is
+/// restarted.
+///
+/// Overriding functions must have the signature expected by
+/// \c dynamic_derived_class::override_member_function, and must be
+/// exported with unmangled names (e.g. declared \c extern \c "C").
+/// Functions in the main program are only exported if it is linked
+/// with \c -rdynamic or equivalent.  The \c bind member function
+/// templates use templates defined in dynamicclass.ipp, which must be
+/// included where they are instantiated.
+#ifndef MAME_LIB_UTIL_DYNAMICMODULE_H
+#define MAME_LIB_UTIL_DYNAMICMODULE_H
+
+#pragma once
+
+#include "dynamicclass.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+
+namespace util {
+
+/// \brief Override module loader
+///
+/// Binds member functions of dynamic derived classes to symbols, and
+/// loads shared objects that supply the overriding functions.  Loading
+/// a module resolves every bound symbol before any class is modified,
+/// so a module that is missing a symbol is rejected without affecting
+/// the module currently in use.  Each virtual table entry is replaced
+/// with a single store, so calls never see a partially-updated entry,
+/// but calls made while a module is being loaded may see a mixture of
+/// functions from the previous and new modules.
+///
+/// Modules that have been replaced are retired rather than unloaded
+/// immediately.  Threads that may call overriding functions register a
+/// \c reader and periodically report a quiescent state, at a point
+/// where they are not executing code from any module and hold no
+/// pointers to it.  A retired module is unloaded once every online
+/// reader has reported a quiescent state after it was retired.
+/// Threads that call overriding functions without being registered as
+/// readers are not accounted for.
+///
+/// If a class uses virtual table replicas, all of its replicas are
+/// refreshed whenever a bound member function is overridden or
+/// restored, before the previous module is retired, so no replica
+/// still refers to a module once it can be unloaded.
+///
+/// Classes with bound member functions must not be destroyed before
+/// the loader, unless \c unload is called first.  The loader must not
+/// be destroyed while any readers are registered.
+class dynamic_override_loader
+{
+public:
+	class reader;
+
+	dynamic_override_loader();
+	~dynamic_override_loader();
+
+	dynamic_override_loader(dynamic_override_loader const &) = delete;
+	dynamic_override_loader &operator=(dynamic_override_loader const &) = delete;
+
+	template <class Base, typename Extra, std::size_t VirtualCount, typename R, typename... T>
+	std::error_code bind(
+			dynamic_derived_class<Base, Extra, VirtualCount> &cls,
+			R (Base::*slot)(T...),
+			std::string_view symbol);
+
+	template <class Base, typename Extra, std::size_t VirtualCount, typename R, typename... T>
+	std::error_code bind(
+			dynamic_derived_class<Base, Extra, VirtualCount> &cls,
+			R (Base::*slot)(T...) const,
+			std::string_view symbol);
+
+	std::error_code load(char const *path);
+	void unload();
+	std::size_t reclaim();
+
+	/// \brief Get number of retired modules
+	///
+	/// Gets the number of modules that have been replaced or unloaded,
+	/// but may still be in use by readers.
+	/// \return The number of retired modules that have not been
+	///   unloaded.
+	std::size_t retired() const
+	{
+		std::lock_guard<std::mutex> guard(m_mutex);
+		return m_retired.size();
+	}
+
+	/// \brief Get current epoch
+	///
+	/// Gets the epoch counter, which is incremented each time a module
+	/// is retired.
+	/// \return The current epoch.
+	std::uint64_t epoch() const noexcept
+	{
+		return m_epoch.load(std::memory_order_acquire);
+	}
+
+private:
+	/// \brief Bound member function
+	///
+	/// Type-erased association between a symbol and a member function
+	/// of a dynamic derived class.
+	class binding
+	{
+	public:
+		binding(std::string_view symbol) : m_symbol(symbol) { }
+		virtual ~binding() = default;
+
+		std::string const &symbol() const { return m_symbol; }
+
+		virtual std::error_code apply(std::uintptr_t func) noexcept = 0;
+		virtual void restore() noexcept = 0;
+
+	private:
+		std::string const m_symbol;
+	};
+
+	template <class Class, typename Slot, typename Func>
+	class member_binding;
+
+	/// \brief Retired module
+	struct retired_module
+	{
+		void *handle;           ///< Module handle
+		std::uint64_t epoch;    ///< Epoch after the module was retired
+	};
+
+	std::error_code add_binding(std::unique_ptr<binding> &&bound);
+	void retire_current();
+	std::size_t reclaim_retired();
+
+	mutable std::mutex m_mutex;                     ///< Protects bindings, modules and readers
+	std::vector<std::unique_ptr<binding> > m_bindings; ///< Bound member functions
+	void *m_current;                                ///< Handle for module in use, or nullptr
+	std::vector<retired_module> m_retired;          ///< Modules waiting to be unloaded
+	std::vector<reader *> m_readers;                ///< Registered readers
+	std::atomic<std::uint64_t> m_epoch;             ///< Incremented when a module is retired
+};
+
+
+/// \brief Override module reader registration
+///
+/// Registers a thread that may call overriding functions supplied by
+/// modules.  The reader is online when created.  An online reader must
+/// periodically call \c quiescent to allow retired modules to be
+/// unloaded.  A reader that will not call overriding functions for an
+/// extended period should go offline, so it does not delay unloading.
+/// A reader should only be used by one thread.
+class dynamic_override_loader::reader
+{
+public:
+	reader(dynamic_override_loader &loader);
+	~reader();
+
+	reader(reader const &) = delete;
+	reader &operator=(reader const &) = delete;
+
+	/// \brief Report quiescent state
+	///
+	/// Indicates that the thread is not executing code from any module
+	/// and holds no pointers to it.  Inexpensive enough to call once
+	/// per iteration of a main loop.
+	void quiescent() noexcept
+	{
+		m_seen.store(m_loader.m_epoch.load(std::memory_order_acquire), std::memory_order_seq_cst);
+	}
+
+	/// \brief Go offline
+	///
+	/// Indicates that the thread will not call overriding functions
+	/// until it goes online again.  Retired modules can be unloaded
+	/// without waiting for the reader while it is offline.
+	void offline() noexcept
+	{
+		m_seen.store(OFFLINE, std::memory_order_seq_cst);
+	}
+
+	/// \brief Go online
+	///
+	/// Indicates that the thread may call overriding functions again
+	/// after going offline.
+	void online() noexcept
+	{
+		quiescent();
+	}
+
+private:
+	friend class dynamic_override_loader;
+
+	static constexpr std::uint64_t OFFLINE = ~std::uint64_t(0);
+
+	dynamic_override_loader &m_loader;          ///< Loader the reader is registered with
+	alignas(64) std::atomic<std::uint64_t> m_seen; ///< Epoch at last quiescent state
+};
+
+
+/// \brief Bound member function of a specific dynamic derived class
+///
+/// Overrides and restores a member function of a dynamic derived class
+/// using the non-throwing interface, and refreshes the class's virtual
+/// table replicas so none of them refer to the previous function.
+/// \tparam Class Dynamic derived class type.
+/// \tparam Slot Pointer to member function type.
+/// \tparam Func Overriding function pointer type.
+template <class Class, typename Slot, typename Func>
+class dynamic_override_loader::member_binding : public binding
+{
+public:
+	member_binding(Class &cls, Slot slot, std::string_view symbol) :
+		binding(symbol),
+		m_class(cls),
+		m_slot(slot)
+	{
+	}
+
+	virtual std::error_code apply(std::uintptr_t func) noexcept override
+	{
+		std::error_code const err = m_class.try_override_member_function(m_slot, reinterpret_cast<Func>(func));
+		m_class.refresh_replicas();
+		return err;
+	}
+
+	virtual void restore() noexcept override
+	{
+		m_class.try_restore_base_member_function(m_slot);
+		m_class.refresh_replicas();
+	}
+
+private:
+	Class &m_class;     ///< Dynamic derived class
+	Slot const m_slot;  ///< Member function to override
+};
+
+
+/// \brief Bind a member function to a symbol
+///
+/// Associates a member function of a dynamic derived class with the
+/// name of the function that overrides it in modules.  If a module is
+/// currently loaded, the member function is overridden immediately.
+/// \tparam Base Base class of the dynamic derived class (usually
+///   determined automatically).
+/// \tparam Extra Extra data type of the dynamic derived class (usually
+///   determined automatically).
+/// \tparam VirtualCount Virtual member function count of the dynamic
+///   derived class (usually determined automatically).
+/// \tparam R Return type of the member function (usually determined
+///   automatically).
+/// \tparam T Parameter types expected by the member function (usually
+///   determined automatically).
+/// \param [in] cls The dynamic derived class.  Must not be destroyed
+///   while the binding is in effect.
+/// \param [in] slot A pointer to the base class member function to
+///   override.  Must be a pointer to a virtual member function.
+/// \param [in] symbol Name of the overriding function in modules.
+/// \return An error code if the member function cannot be overridden,
+///   or a module is loaded and does not export the symbol.  The
+///   binding is not added if an error is returned.
+template <class Base, typename Extra, std::size_t VirtualCount, typename R, typename... T>
+inline std::error_code dynamic_override_loader::bind(
+		dynamic_derived_class<Base, Extra, VirtualCount> &cls,
+		R (Base::*slot)(T...),
+		std::string_view symbol)
+{
+	using class_type = dynamic_derived_class<Base, Extra, VirtualCount>;
+	using func_type = R MAME_ABI_CXX_MEMBER_CALL (*)(typename class_type::type &, T...);
+	std::size_t index;
+	std::error_code const err = class_type::try_resolve_member_function(slot, index);
+	if (err)
+		return err;
+	return add_binding(std::make_unique<member_binding<class_type, decltype(slot), func_type> >(cls, slot, symbol));
+}
+
+template <class Base, typename Extra, std::size_t VirtualCount, typename R, typename... T>
+inline std::error_code dynamic_override_loader::bind(
+		dynamic_derived_class<Base, Extra, VirtualCount> &cls,
+		R (Base::*slot)(T...) const,
+		std::string_view symbol)
+{
+	using class_type = dynamic_derived_class<Base, Extra, VirtualCount>;
+	using func_type = R MAME_ABI_CXX_MEMBER_CALL (*)(typename class_type::type const &, T...);
+	std::size_t index;
+	std::error_code const err = class_type::try_resolve_member_function(slot, index);
+	if (err)
+		return err;
+	return add_binding(std::make_unique<member_binding<class_type, decltype(slot), func_type> >(cls, slot, symbol));
+}
+
+
+
+/// \brief Persistent override cache
+///
+/// Saves the overridden member functions of dynamic derived classes in
+/// a compact file, identifying overriding functions by exported symbol
+/// name.  In a later run of the program, the file can be mapped into
+/// memory and used to override the same member functions of newly
+/// created classes without profiling or rebuilding them.
+///
+/// Classes are identified by name, and saved classes are sorted by name
+/// so they can be found in the mapped file without building an index.
+/// Overriding functions must be exported, so they can be named using
+/// \c dladdr and found again using \c dlsym.  Classes using JIT code
+/// or functions that are not exported cannot be saved.
+///
+/// Saving classes is not supported on Windows, or for configurations
+/// that use function descriptors in virtual tables.
+class dynamic_override_cache
+{
+public:
+	dynamic_override_cache();
+	~dynamic_override_cache();
+
+	dynamic_override_cache(dynamic_override_cache const &) = delete;
+	dynamic_override_cache &operator=(dynamic_override_cache const &) = delete;
+
+	/// \brief Save class overrides
+	///
+	/// Records the overridden member functions of a dynamic derived
+	/// class, replacing any record of a class with the same name.  The
+	/// class is not referenced after this returns.
+	/// Overrides of secondary base class member functions cannot be
+	/// saved.
+	/// \param [in] cls The dynamic derived class to save.
+	/// \return An error code if an overriding function cannot be named,
+	///   or a member function of a secondary base class is overridden.
+	///   The class is not saved if an error is returned.
+	template <class Base, typename Extra, std::size_t VirtualCount>
+	std::error_code add(dynamic_derived_class<Base, Extra, VirtualCount> const &cls)
+	{
+		return add(static_cast<detail::dynamic_derived_class_base const &>(cls));
+	}
+
+	std::error_code write(char const *path) const;
+
+	std::error_code read(char const *path);
+	void close();
+
+	/// \brief Get number of classes in file
+	///
+	/// Gets the number of classes in the file that was read.
+	/// \return The number of classes available to apply, or zero if no
+	///   file has been read.
+	std::size_t size() const { return m_header ? m_header->class_count : 0; }
+
+	/// \brief Test whether a class is in file
+	///
+	/// Tests whether the file that was read contains overrides for a
+	/// class with the same name as the specified class.
+	/// \param [in] cls The dynamic derived class to look for.
+	/// \return True if the class is in the file, or false otherwise.
+	template <class Base, typename Extra, std::size_t VirtualCount>
+	bool contains(dynamic_derived_class<Base, Extra, VirtualCount> const &cls) const
+	{
+		return find(static_cast<detail::dynamic_derived_class_base const &>(cls)) != nullptr;
+	}
+
+	/// \brief Apply cached overrides
+	///
+	/// Overrides member functions of a dynamic derived class using the
+	/// functions saved for the class with the same name in the file that
+	/// was read.  All symbols are resolved before the class is modified.
+	/// Member functions that were not overridden when the class was
+	/// saved are not changed.
+	/// \param [in] cls The dynamic derived class to modify.
+	/// \return An error code if the class is not in the file, its
+	///   virtual member function count differs, or an overriding
+	///   function cannot be found.
+	template <class Base, typename Extra, std::size_t VirtualCount>
+	std::error_code apply(dynamic_derived_class<Base, Extra, VirtualCount> &cls) const
+	{
+		return apply(static_cast<detail::dynamic_derived_class_base &>(cls));
+	}
+
+private:
+	/// \brief File header
+	struct file_header
+	{
+		std::uint32_t magic;            ///< Identifies the file format and byte order
+		std::uint32_t version;          ///< File format version
+		std::uint32_t class_count;      ///< Number of class records
+		std::uint32_t slot_count;       ///< Number of slot records
+		std::uint32_t string_size;      ///< Size of string table in bytes
+	};
+
+	/// \brief Class record, sorted by name
+	struct file_class
+	{
+		std::uint32_t name;             ///< Offset to class name in string table
+		std::uint32_t virtual_count;    ///< Number of overridable virtual member functions
+		std::uint32_t first_slot;       ///< Index of first slot record
+		std::uint32_t slot_count;       ///< Number of slot records
+	};
+
+	/// \brief Slot record
+	struct file_slot
+	{
+		std::uint32_t index;            ///< Overridable member function index
+		std::uint32_t symbol;           ///< Offset to symbol name in string table
+	};
+
+	/// \brief Class saved for writing
+	struct saved_class
+	{
+		std::string name;                                               ///< Class name
+		std::size_t virtual_count;                                      ///< Number of overridable virtual member functions
+		std::vector<std::pair<std::size_t, std::string> > slots;        ///< Overridden member function indices and symbol names
+	};
+
+	static constexpr std::uint32_t MAGIC = 0x43444d4d; // "MMDC" in little-endian byte order
+	static constexpr std::uint32_t VERSION = 1;
+
+	std::error_code add(detail::dynamic_derived_class_base const &cls);
+	file_class const *find(detail::dynamic_derived_class_base const &cls) const;
+	std::error_code apply(detail::dynamic_derived_class_base &cls) const;
+	bool validate() const;
+
+	std::vector<saved_class> m_saved;           ///< Classes saved for writing
+	void *m_mapping;                            ///< Mapped file, or nullptr
+	std::size_t m_size;                         ///< Size of file that was read
+	std::unique_ptr<std::uint8_t []> m_buffer;  ///< File contents if not mapped
+	file_header const *m_header;                ///< Header of file that was read, or nullptr
+	file_class const *m_classes;                ///< Class records of file that was read
+	file_slot const *m_slots;                   ///< Slot records of file that was read
+	char const *m_strings;                      ///< String table of file that was read
+};
+
+} // namespace util
+
+#endif // MAME_LIB_UTIL_DYNAMICMODULE_H